@@ -0,0 +1,536 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the detail of the CorpusGenerator class.
+
+#include "corpus_generator.h"
+
+#include <QtCore>
+
+#include "qmeta/exif.h"
+#include "qmeta/iptc.h"
+#include "qmeta/tiff_header.h"
+
+namespace qmeta {
+
+namespace {
+
+// The tags written to TIFF files only.
+enum {
+  kStripOffsetsTag = 273,
+  kRowsPerStripTag = 278,
+  kStripByteCountsTag = 279,
+  kXmpTag = 700,
+  kIptcTag = 33723,
+};
+
+// A deterministic pseudo-random byte generator so every generated corpus is
+// identical.
+class FillerGenerator {
+ public:
+  explicit FillerGenerator(quint32 seed) : state_(seed) {}
+
+  // Returns the next pseudo-random byte.
+  char NextByte() {
+    state_ = state_ * 1103515245 + 12345;
+    return static_cast<char>(state_ >> 16);
+  }
+
+  // Returns size pseudo-random bytes. If is_entropy_coded is true, every
+  // 0xff byte is followed by a stuffed 0x00 byte as in JPEG scan data.
+  QByteArray Bytes(int size, bool is_entropy_coded) {
+    QByteArray bytes;
+    bytes.reserve(size + 1);
+    while (bytes.size() < size) {
+      char byte = NextByte();
+      bytes.append(byte);
+      if (is_entropy_coded && byte == '\xff')
+        bytes.append('\0');
+    }
+    return bytes;
+  }
+
+ private:
+  quint32 state_;
+};
+
+// Builds a TIFF structure in a specific byte order. IFDs are appended to the
+// end of the data, and offsets can be patched after the target is written.
+class TiffBuilder {
+ public:
+  // The ways to link a written IFD.
+  enum Link {
+    kLinkFromHeader,  // Linked as the first IFD
+    kLinkFromPrevious,  // Linked from the previous linked IFD
+    kUnlinked,  // Not part of the IFD chain, e.g. the Exif IFD
+  };
+
+  explicit TiffBuilder(Endianness byte_order)
+      : byte_order_(byte_order), next_pointer_offset_(0) {
+    if (byte_order == kBigEndians)
+      data_.append("MM");
+    else
+      data_.append("II");
+    AppendUInt16(&data_, 42);
+    AppendUInt32(&data_, 8);
+  }
+
+  // Adds a field to the next IFD. The value is in the byte order of the
+  // builder.
+  void AddField(int tag, TiffHeader::Type type, quint32 count,
+                const QByteArray &value) {
+    Field field = {tag, type, count, value};
+    fields_.append(field);
+  }
+
+  // Adds a NULL-terminated ASCII field to the next IFD.
+  void AddAscii(int tag, const QByteArray &value) {
+    QByteArray ascii = value;
+    ascii.append('\0');
+    AddField(tag, TiffHeader::kAsciiType, ascii.size(), ascii);
+  }
+
+  // Adds a LONG field to the next IFD.
+  void AddLong(int tag, quint32 value) {
+    QByteArray bytes;
+    AppendUInt32(&bytes, value);
+    AddField(tag, TiffHeader::kLongType, 1, bytes);
+  }
+
+  // Adds a RATIONAL field holding the specified numerator and denominator
+  // pairs to the next IFD.
+  void AddRationals(int tag, const QList<quint32> &values) {
+    QByteArray bytes;
+    for (int i = 0; i < values.count(); ++i)
+      AppendUInt32(&bytes, values.at(i));
+    AddField(tag, TiffHeader::kRationalType, values.count() / 2, bytes);
+  }
+
+  // Adds a SHORT field to the next IFD.
+  void AddShort(int tag, quint16 value) {
+    QByteArray bytes;
+    AppendUInt16(&bytes, value);
+    AddField(tag, TiffHeader::kShortType, 1, bytes);
+  }
+
+  // Appends the specified bytes to the data and returns their offset.
+  int AppendData(const QByteArray &bytes) {
+    if (data_.size() % 2)
+      data_.append('\0');
+    int offset = data_.size();
+    data_.append(bytes);
+    return offset;
+  }
+
+  // Appends the 16-bit value in the byte order of the builder.
+  void AppendUInt16(QByteArray *bytes, quint16 value) const {
+    uchar buffer[2];
+    if (byte_order_ == kBigEndians)
+      qToBigEndian(value, buffer);
+    else
+      qToLittleEndian(value, buffer);
+    bytes->append(reinterpret_cast<char*>(buffer), 2);
+  }
+
+  // Appends the 32-bit value in the byte order of the builder.
+  void AppendUInt32(QByteArray *bytes, quint32 value) const {
+    uchar buffer[4];
+    if (byte_order_ == kBigEndians)
+      qToBigEndian(value, buffer);
+    else
+      qToLittleEndian(value, buffer);
+    bytes->append(reinterpret_cast<char*>(buffer), 4);
+  }
+
+  // Overwrites the 32-bit value at the specified offset.
+  void PatchUInt32(int offset, quint32 value) {
+    QByteArray bytes;
+    AppendUInt32(&bytes, value);
+    data_.replace(offset, 4, bytes);
+  }
+
+  // Writes all added fields as an IFD sorted by tag followed by the values
+  // not fitting in the entries, and links it as specified. Returns the
+  // offset of the IFD.
+  int WriteIfd(Link link) {
+    qStableSort(fields_.begin(), fields_.end(), FieldLessThan);
+    int ifd_offset = AppendData(QByteArray());
+    if (link == kLinkFromHeader)
+      PatchUInt32(4, ifd_offset);
+    else if (link == kLinkFromPrevious && next_pointer_offset_ > 0)
+      PatchUInt32(next_pointer_offset_, ifd_offset);
+
+    int value_offset = ifd_offset + 2 + fields_.count() * 12 + 4;
+    QByteArray values;
+    value_field_offsets_.clear();
+    AppendUInt16(&data_, fields_.count());
+    for (int i = 0; i < fields_.count(); ++i) {
+      const Field &field = fields_.at(i);
+      AppendUInt16(&data_, field.tag);
+      AppendUInt16(&data_, field.type);
+      AppendUInt32(&data_, field.count);
+      value_field_offsets_.insert(field.tag, data_.size());
+      if (field.value.size() <= 4) {
+        data_.append(field.value);
+        data_.append(QByteArray(4 - field.value.size(), '\0'));
+      } else {
+        AppendUInt32(&data_, value_offset + values.size());
+        values.append(field.value);
+        if (values.size() % 2)
+          values.append('\0');
+      }
+    }
+    if (link != kUnlinked)
+      next_pointer_offset_ = data_.size();
+    AppendUInt32(&data_, 0);
+    data_.append(values);
+    fields_.clear();
+    return ifd_offset;
+  }
+
+  // Returns the offset of the value field of the specified tag in the last
+  // written IFD.
+  int ValueFieldOffset(int tag) const {
+    return value_field_offsets_.value(tag);
+  }
+
+  const QByteArray& data() const { return data_; }
+
+ private:
+  // A field waiting to be written.
+  struct Field {
+    int tag;
+    TiffHeader::Type type;
+    quint32 count;
+    QByteArray value;
+  };
+
+  // Returns true if the tag of the first field is less than the second's.
+  static bool FieldLessThan(const Field &field1, const Field &field2) {
+    return field1.tag < field2.tag;
+  }
+
+  // The byte order of the TIFF structure.
+  Endianness byte_order_;
+  // The TIFF structure built so far.
+  QByteArray data_;
+  // The fields of the next IFD.
+  QList<Field> fields_;
+  // The offset of the next IFD pointer of the last linked IFD.
+  int next_pointer_offset_;
+  // The offsets of the value fields in the last written IFD keyed by tag.
+  QHash<int, int> value_field_offsets_;
+};
+
+// Returns the IPTC application record of the specified sample.
+QByteArray GenerateIptc(const CorpusGenerator::Sample &sample) {
+  QList<QPair<int, QByteArray> > data_sets;
+  data_sets.append(qMakePair(static_cast<int>(Iptc::kRecordVersion),
+                             QByteArray("\x00\x04", 2)));
+  data_sets.append(qMakePair(static_cast<int>(Iptc::kObjectName),
+                             sample.name.toAscii()));
+  for (int i = 0; i < 8; ++i) {
+    data_sets.append(qMakePair(static_cast<int>(Iptc::kKeywords),
+                               QByteArray("keyword-") +
+                               QByteArray::number(i)));
+  }
+  data_sets.append(qMakePair(static_cast<int>(Iptc::kCaptionAbstract),
+                             QByteArray(512, 'c')));
+
+  QByteArray record;
+  for (int i = 0; i < data_sets.count(); ++i) {
+    const QByteArray &value = data_sets.at(i).second;
+    record.append("\x1c\x02", 2);
+    record.append(static_cast<char>(data_sets.at(i).first));
+    record.append(static_cast<char>(value.size() >> 8));
+    record.append(static_cast<char>(value.size()));
+    record.append(value);
+  }
+  return record;
+}
+
+// Returns the XMP packet of the specified sample including 2KB of padding.
+QByteArray GenerateXmp(const CorpusGenerator::Sample &sample) {
+  QByteArray packet;
+  packet.append("<?xpacket begin=\"\xef\xbb\xbf\" "
+                "id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n");
+  packet.append("<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+                " <rdf:RDF xmlns:rdf="
+                "\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+                "  <rdf:Description rdf:about=\"\" "
+                "xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+                "   <dc:title>");
+  packet.append(sample.name.toAscii());
+  packet.append("</dc:title>\n"
+                "  </rdf:Description>\n"
+                " </rdf:RDF>\n"
+                "</x:xmpmeta>\n");
+  packet.append(QByteArray(2048, ' '));
+  packet.append("\n<?xpacket end=\"w\"?>");
+  return packet;
+}
+
+// Returns a minimal JPEG stream of the specified size used as thumbnail.
+QByteArray GenerateThumbnail(int size, FillerGenerator *filler) {
+  QByteArray thumbnail("\xff\xd8", 2);
+  thumbnail.append(filler->Bytes(qMax(0, size - 4), false));
+  thumbnail.append("\xff\xd9", 2);
+  return thumbnail;
+}
+
+// Returns the TIFF structure of the specified sample. If is_tiff_file is
+// true, the structure is a complete TIFF file with strip data, IPTC and XMP,
+// otherwise it is the Exif content of a JPEG file.
+QByteArray GenerateTiff(const CorpusGenerator::Sample &sample,
+                        bool is_tiff_file, FillerGenerator *filler) {
+  TiffBuilder builder(sample.byte_order);
+  int strip_offset = 0;
+  if (is_tiff_file)
+    strip_offset = builder.AppendData(filler->Bytes(sample.image_data_size,
+                                                    false));
+
+  // IFD0.
+  builder.AddLong(Exif::kImageWidth, 640);
+  builder.AddLong(Exif::kImageLength, 480);
+  builder.AddAscii(Exif::kMake, "QMeta");
+  builder.AddAscii(Exif::kModel,
+                   QByteArray("Synthetic ") + sample.name.toAscii());
+  builder.AddShort(Exif::kOrientation, 1);
+  builder.AddRationals(Exif::kXResolution, QList<quint32>() << 72 << 1);
+  builder.AddRationals(Exif::kYResolution, QList<quint32>() << 72 << 1);
+  builder.AddShort(Exif::kResolutionUnit, 2);
+  builder.AddAscii(Exif::kDateTime, "2010:01:01 00:00:00");
+  if (sample.has_exif)
+    builder.AddLong(Exif::kExifIfdPointer, 0);
+  if (sample.has_gps)
+    builder.AddLong(Exif::kGpsInfoIfdPointer, 0);
+  if (is_tiff_file) {
+    builder.AddLong(kStripOffsetsTag, strip_offset);
+    builder.AddLong(kRowsPerStripTag, 480);
+    builder.AddLong(kStripByteCountsTag, sample.image_data_size);
+    if (sample.has_iptc) {
+      QByteArray iptc = GenerateIptc(sample);
+      builder.AddField(kIptcTag, TiffHeader::kUndefinedType, iptc.size(),
+                       iptc);
+    }
+    if (sample.has_xmp) {
+      QByteArray xmp = GenerateXmp(sample);
+      builder.AddField(kXmpTag, TiffHeader::kByteType, xmp.size(), xmp);
+    }
+  }
+  builder.WriteIfd(TiffBuilder::kLinkFromHeader);
+  int exif_pointer_offset = builder.ValueFieldOffset(Exif::kExifIfdPointer);
+  int gps_pointer_offset = builder.ValueFieldOffset(Exif::kGpsInfoIfdPointer);
+
+  // IFD1 and the extra IFDs are chained after IFD0.
+  if (sample.thumbnail_size > 0) {
+    builder.AddShort(Exif::kCompression, 6);
+    builder.AddLong(Exif::kJPEGInterchangeFormat, 0);
+    builder.AddLong(Exif::kJPEGInterchangeFormatLength,
+                    sample.thumbnail_size);
+    builder.WriteIfd(TiffBuilder::kLinkFromPrevious);
+    int thumbnail_pointer_offset =
+        builder.ValueFieldOffset(Exif::kJPEGInterchangeFormat);
+    for (int i = 0; i < sample.extra_ifd_count; ++i) {
+      builder.AddLong(Exif::kImageWidth, 64 + i);
+      builder.AddLong(Exif::kImageLength, 48 + i);
+      builder.AddShort(Exif::kCompression, 1);
+      builder.WriteIfd(TiffBuilder::kLinkFromPrevious);
+    }
+    int thumbnail_offset = builder.AppendData(
+        GenerateThumbnail(sample.thumbnail_size, filler));
+    builder.PatchUInt32(thumbnail_pointer_offset, thumbnail_offset);
+  }
+
+  if (sample.has_exif) {
+    builder.AddRationals(Exif::kExposureTime, QList<quint32>() << 1 << 125);
+    builder.AddRationals(Exif::kFNumber, QList<quint32>() << 28 << 10);
+    builder.AddShort(Exif::kISOSpeedRatings, 200);
+    builder.AddField(Exif::kExifVersion, TiffHeader::kUndefinedType, 4,
+                     "0230");
+    builder.AddAscii(Exif::kDateTimeOriginal, "2010:01:01 00:00:00");
+    builder.AddField(Exif::kUserComment, TiffHeader::kUndefinedType, 72,
+                     QByteArray("ASCII\0\0\0", 8) + QByteArray(64, 'u'));
+    int exif_ifd_offset = builder.WriteIfd(TiffBuilder::kUnlinked);
+    builder.PatchUInt32(exif_pointer_offset, exif_ifd_offset);
+  }
+  if (sample.has_gps) {
+    QByteArray version("\x02\x03\x00\x00", 4);
+    builder.AddField(Exif::kGPSVersionID, TiffHeader::kByteType, 4, version);
+    builder.AddAscii(Exif::kGPSLatitudeRef, "N");
+    builder.AddRationals(Exif::kGPSLatitude,
+                         QList<quint32>() << 25 << 1 << 2 << 1 << 3 << 1);
+    builder.AddAscii(Exif::kGPSLongitudeRef, "E");
+    builder.AddRationals(Exif::kGPSLongitude,
+                         QList<quint32>() << 121 << 1 << 30 << 1 << 0 << 1);
+    int gps_ifd_offset = builder.WriteIfd(TiffBuilder::kUnlinked);
+    builder.PatchUInt32(gps_pointer_offset, gps_ifd_offset);
+  }
+  return builder.data();
+}
+
+// Appends a JPEG marker segment with the specified marker and payload.
+void AppendSegment(QByteArray *jpeg, int marker, const QByteArray &payload) {
+  int length = payload.size() + 2;
+  jpeg->append('\xff');
+  jpeg->append(static_cast<char>(marker));
+  jpeg->append(static_cast<char>(length >> 8));
+  jpeg->append(static_cast<char>(length));
+  jpeg->append(payload);
+}
+
+// Returns the JPEG file of the specified sample.
+QByteArray GenerateJpeg(const CorpusGenerator::Sample &sample,
+                        FillerGenerator *filler) {
+  QByteArray jpeg("\xff\xd8", 2);
+  AppendSegment(&jpeg, 0xe0, QByteArray("JFIF\0\x01\x02\0\0\x01\0\x01\0\0",
+                                        14));
+  if (sample.has_exif || sample.has_gps || sample.thumbnail_size > 0) {
+    QByteArray exif("Exif\0\0", 6);
+    exif.append(GenerateTiff(sample, false, filler));
+    AppendSegment(&jpeg, 0xe1, exif);
+  }
+  if (sample.has_xmp) {
+    QByteArray xmp("http://ns.adobe.com/xap/1.0/\0", 29);
+    xmp.append(GenerateXmp(sample));
+    AppendSegment(&jpeg, 0xe1, xmp);
+  }
+  if (sample.has_iptc) {
+    QByteArray iptc = GenerateIptc(sample);
+    QByteArray photoshop("Photoshop 3.0\0", 14);
+    photoshop.append("8BIM\x04\x04\0\0", 8);
+    photoshop.append(static_cast<char>(iptc.size() >> 24));
+    photoshop.append(static_cast<char>(iptc.size() >> 16));
+    photoshop.append(static_cast<char>(iptc.size() >> 8));
+    photoshop.append(static_cast<char>(iptc.size()));
+    photoshop.append(iptc);
+    if (iptc.size() % 2)
+      photoshop.append('\0');
+    AppendSegment(&jpeg, 0xed, photoshop);
+  }
+  AppendSegment(&jpeg, 0xdb, QByteArray(1, '\0') + QByteArray(64, '\x01'));
+  AppendSegment(&jpeg, 0xc0, QByteArray("\x08\x01\xe0\x02\x80\x01\x01\x11\0",
+                                        9));
+  AppendSegment(&jpeg, 0xda, QByteArray("\x01\x01\0\0\x3f\0", 6));
+  jpeg.append(filler->Bytes(sample.image_data_size, true));
+  jpeg.append("\xff\xd9", 2);
+  return jpeg;
+}
+
+// Returns a sample with all metadata and the specified properties.
+CorpusGenerator::Sample MakeSample(const QString &name, FileType file_type,
+                                   Endianness byte_order) {
+  CorpusGenerator::Sample sample;
+  sample.name = name;
+  sample.file_type = file_type;
+  sample.byte_order = byte_order;
+  sample.has_exif = true;
+  sample.has_gps = true;
+  sample.has_iptc = true;
+  sample.has_xmp = true;
+  sample.thumbnail_size = 8 * 1024;
+  sample.extra_ifd_count = 0;
+  sample.image_data_size = 256 * 1024;
+  return sample;
+}
+
+}  // namespace
+
+// Returns the samples of the default corpus. Each variation is generated in
+// both byte orders.
+QList<CorpusGenerator::Sample> CorpusGenerator::DefaultSamples() {
+  QList<Sample> samples;
+  for (int i = 0; i < 2; ++i) {
+    Endianness byte_order = i ? kBigEndians : kLittleEndians;
+    QString suffix = i ? "_mm" : "_ii";
+
+    samples.append(MakeSample("jpeg_full" + suffix, kJpegFileType,
+                              byte_order));
+    Sample sample = MakeSample("jpeg_bare" + suffix, kJpegFileType,
+                               byte_order);
+    sample.has_exif = sample.has_gps = sample.has_iptc = false;
+    sample.has_xmp = false;
+    sample.thumbnail_size = 0;
+    samples.append(sample);
+    sample = MakeSample("jpeg_exif_only" + suffix, kJpegFileType, byte_order);
+    sample.has_gps = sample.has_iptc = sample.has_xmp = false;
+    samples.append(sample);
+    sample = MakeSample("jpeg_large_thumbnail" + suffix, kJpegFileType,
+                        byte_order);
+    sample.thumbnail_size = 60 * 1024;
+    samples.append(sample);
+    sample = MakeSample("jpeg_many_ifds" + suffix, kJpegFileType, byte_order);
+    sample.extra_ifd_count = 32;
+    samples.append(sample);
+    sample = MakeSample("jpeg_big_scan" + suffix, kJpegFileType, byte_order);
+    sample.image_data_size = 8 * 1024 * 1024;
+    samples.append(sample);
+
+    samples.append(MakeSample("tiff_full" + suffix, kTiffFileType,
+                              byte_order));
+    sample = MakeSample("tiff_no_exif" + suffix, kTiffFileType, byte_order);
+    sample.has_exif = sample.has_gps = false;
+    samples.append(sample);
+    sample = MakeSample("tiff_many_ifds" + suffix, kTiffFileType, byte_order);
+    sample.extra_ifd_count = 64;
+    samples.append(sample);
+    sample = MakeSample("tiff_metadata_after_data" + suffix, kTiffFileType,
+                        byte_order);
+    sample.image_data_size = 8 * 1024 * 1024;
+    samples.append(sample);
+  }
+  return samples;
+}
+
+// Returns the content of the file described by the specified sample. The
+// same sample always generates the same content.
+QByteArray CorpusGenerator::Generate(const Sample &sample) {
+  FillerGenerator filler(qHash(sample.name));
+  if (sample.file_type == kTiffFileType)
+    return GenerateTiff(sample, true, &filler);
+  return GenerateJpeg(sample, &filler);
+}
+
+// Writes all samples of the default corpus to the specified directory and
+// returns the paths to the written files. Returns an empty list if any file
+// cannot be written.
+QStringList CorpusGenerator::WriteCorpus(const QString &directory) {
+  QDir dir(directory);
+  if (!dir.exists() && !dir.mkpath("."))
+    return QStringList();
+
+  QStringList file_names;
+  QList<Sample> samples = DefaultSamples();
+  for (int i = 0; i < samples.count(); ++i) {
+    const Sample &sample = samples.at(i);
+    QString extension = sample.file_type == kTiffFileType ? ".tif" : ".jpg";
+    QString file_name = dir.filePath(sample.name + extension);
+    QFile file(file_name);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        file.write(Generate(sample)) == -1)
+      return QStringList();
+    file_names.append(file_name);
+  }
+  return file_names;
+}
+
+}  // namespace qmeta
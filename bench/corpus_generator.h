@@ -0,0 +1,73 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file defines the CorpusGenerator class which generates deterministic
+// synthetic JPEG and TIFF files for benchmarking. The generated files only
+// contain the structures QMeta parses, the image data is filler.
+
+#ifndef QMETA_BENCH_CORPUS_GENERATOR_H_
+#define QMETA_BENCH_CORPUS_GENERATOR_H_
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include "qmeta/identifiers.h"
+
+namespace qmeta {
+
+class CorpusGenerator {
+ public:
+  // Describes a generated file.
+  struct Sample {
+    // The file name of the sample, unique in the corpus.
+    QString name;
+    // Either kJpegFileType or kTiffFileType.
+    FileType file_type;
+    // The byte order of the TIFF structure.
+    Endianness byte_order;
+    // Whether the Exif IFD is included.
+    bool has_exif;
+    // Whether the GPS IFD is included.
+    bool has_gps;
+    // Whether IPTC is included.
+    bool has_iptc;
+    // Whether XMP is included.
+    bool has_xmp;
+    // The size of the thumbnail in IFD1, or 0 if there is no IFD1.
+    int thumbnail_size;
+    // The number of extra IFDs chained after IFD1.
+    int extra_ifd_count;
+    // The size of the scan data in JPEG files or the strip data in TIFF
+    // files. The strip data precedes all metadata in TIFF files.
+    int image_data_size;
+  };
+
+  static QList<Sample> DefaultSamples();
+  static QByteArray Generate(const Sample &sample);
+  static QStringList WriteCorpus(const QString &directory);
+};
+
+}  // namespace qmeta
+
+#endif  // QMETA_BENCH_CORPUS_GENERATOR_H_
@@ -0,0 +1,240 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the qmeta_bench program which measures the parse
+// throughput of QMeta over a generated corpus. Usage:
+//
+//   qmeta_bench [corpus_directory] [iterations]
+//
+// The corpus is regenerated in corpus_directory, which defaults to a
+// directory in the system temporary path. Each benchmark runs over all files
+// of the corpus for the specified iterations, both with memory-mapped files
+// and with files read through QFile, and reports files per second, the I/O
+// statistics per file, and heap allocations per file. With glibc, every
+// allocation of the process is counted, including those made by Qt through
+// qMalloc(). Elsewhere only C++ operator new calls are counted, reported as
+// "news/file".
+
+#include <cstdlib>
+#include <new>
+
+#include <QtCore>
+
+#include "corpus_generator.h"
+#include "qmeta/exif.h"
+#include "qmeta/exif_data.h"
+#include "qmeta/file.h"
+#include "qmeta/image.h"
+#include "qmeta/iptc.h"
+
+namespace {
+
+// The number of heap allocations.
+QAtomicInt allocation_count;
+
+}  // namespace
+
+#ifdef __GLIBC__
+
+// The name of the allocation metric in the report.
+const char kAllocationMetric[] = "allocs/file";
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void *pointer, size_t size);
+
+// Interposes the C allocator of glibc for the whole process, so allocations
+// made by Qt containers through qMalloc() and by operator new are counted.
+void* malloc(size_t size) throw() {
+  allocation_count.ref();
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) throw() {
+  allocation_count.ref();
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void *pointer, size_t size) throw() {
+  allocation_count.ref();
+  return __libc_realloc(pointer, size);
+}
+
+}  // extern "C"
+
+#else
+
+// The name of the allocation metric in the report.
+const char kAllocationMetric[] = "news/file";
+
+// Counts every heap allocation made by operator new. Allocations made by Qt
+// containers through qMalloc() are not counted.
+void* operator new(size_t size) throw(std::bad_alloc) {
+  allocation_count.ref();
+  void *pointer = malloc(size ? size : 1);
+  if (!pointer)
+    throw std::bad_alloc();
+  return pointer;
+}
+
+void* operator new[](size_t size) throw(std::bad_alloc) {
+  return operator new(size);
+}
+
+void operator delete(void *pointer) throw() {
+  free(pointer);
+}
+
+void operator delete[](void *pointer) throw() {
+  free(pointer);
+}
+
+#endif  // __GLIBC__
+
+namespace qmeta {
+
+namespace {
+
+// Describes a benchmark run on each file of the corpus.
+struct Benchmark {
+  // The name shown in the report.
+  const char *name;
+  // The options to construct the Image object with.
+  File::Options options;
+  // Runs the measured operations on the constructed Image object.
+  void (*run)(Image *image);
+};
+
+// Parses all metadata standards.
+void ParseAll(Image *image) {
+  image->exif();
+  image->iptc();
+  image->xmp();
+}
+
+// Reads a few Exif values from different IFDs.
+void ReadExifValues(Image *image) {
+  Exif *exif = image->exif();
+  if (!exif)
+    return;
+  exif->Value(Exif::kMake).ToString();
+  exif->Value(Exif::kDateTimeOriginal).ToString();
+  exif->Value(Exif::kGPSLatitude).ToDouble(0);
+}
+
+// Reads a repeatable and a non-repeatable IPTC value.
+void ReadIptcValues(Image *image) {
+  Iptc *iptc = image->iptc();
+  if (!iptc)
+    return;
+  iptc->Value(Iptc::kObjectName);
+  iptc->Values(Iptc::kKeywords);
+}
+
+// Reads the thumbnail.
+void ReadThumbnail(Image *image) {
+  image->Thumbnail();
+}
+
+const Benchmark kBenchmarks[] = {
+  {"parse_all", File::kAllOptions, ParseAll},
+  {"exif_value", File::kExifOption, ReadExifValues},
+  {"iptc_values", File::kIptcOption, ReadIptcValues},
+  {"thumbnail", File::kThumbnailOption, ReadThumbnail},
+};
+
+// Runs the specified benchmark over all specified files for the specified
+// iterations and reports the result to the specified stream. If is_mapped
+// is true, files are opened by name and memory-mapped, otherwise they are
+// read through QFile.
+void RunBenchmark(const Benchmark &benchmark, const QStringList &file_names,
+                  int iterations, bool is_mapped, QTextStream *stream) {
+  IoStatistics statistics;
+  int start_allocation_count = allocation_count;
+  QElapsedTimer timer;
+  timer.start();
+  for (int i = 0; i < iterations; ++i) {
+    for (int j = 0; j < file_names.count(); ++j) {
+      if (is_mapped) {
+        Image image(file_names.at(j), benchmark.options);
+        benchmark.run(&image);
+        statistics += image.io_statistics();
+        continue;
+      }
+      QFile file(file_names.at(j));
+      file.open(QIODevice::ReadOnly);
+      Image image(&file, benchmark.options);
+      benchmark.run(&image);
+      statistics += image.io_statistics();
+    }
+  }
+  qint64 elapsed = qMax(static_cast<qint64>(1), timer.nsecsElapsed());
+  int allocations = allocation_count - start_allocation_count;
+  double file_count = static_cast<double>(iterations) * file_names.count();
+
+  *stream << QString("%1 %2 %3 files/s %4 bytes/file %5 reads/file "
+                     "%6 seeks/file %7 %8\n")
+      .arg(QString(benchmark.name), -12)
+      .arg(QString(is_mapped ? "mapped" : "stream"), -7)
+      .arg(file_count * 1e9 / elapsed, 12, 'f', 1)
+      .arg(statistics.bytes_read / file_count, 12, 'f', 1)
+      .arg(statistics.read_count / file_count, 8, 'f', 1)
+      .arg(statistics.seek_count / file_count, 8, 'f', 1)
+      .arg(allocations / file_count, 10, 'f', 1)
+      .arg(QString(kAllocationMetric));
+  stream->flush();
+}
+
+}  // namespace
+
+}  // namespace qmeta
+
+int main(int argc, char *argv[]) {
+  QCoreApplication application(argc, argv);
+  QStringList arguments = QCoreApplication::arguments();
+  QString directory = QDir::temp().filePath("qmeta_bench_corpus");
+  if (arguments.count() > 1)
+    directory = arguments.at(1);
+  int iterations = 20;
+  if (arguments.count() > 2)
+    iterations = qMax(1, arguments.at(2).toInt());
+
+  QTextStream stream(stdout);
+  QStringList file_names = qmeta::CorpusGenerator::WriteCorpus(directory);
+  if (file_names.isEmpty()) {
+    stream << "Failed to write the corpus to " << directory << "\n";
+    return 1;
+  }
+  stream << "Corpus: " << file_names.count() << " files in " << directory
+         << ", " << iterations << " iterations\n";
+
+  int count = sizeof(qmeta::kBenchmarks) / sizeof(qmeta::kBenchmarks[0]);
+  for (int i = 0; i < count; ++i) {
+    qmeta::RunBenchmark(qmeta::kBenchmarks[i], file_names, iterations, true,
+                        &stream);
+    qmeta::RunBenchmark(qmeta::kBenchmarks[i], file_names, iterations, false,
+                        &stream);
+  }
+  return 0;
+}
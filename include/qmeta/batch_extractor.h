@@ -0,0 +1,149 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file defines the BatchExtractor class which extracts the metadata of
+// many image files in parallel. Files are given as paths to files or to
+// directories which are searched recursively, and each file is parsed as an
+// Image object in a thread pool. The Image objects are delivered through the
+// Extracted() signal either in the order the files are found or as soon as
+// they are parsed. Receivers should be connected with queued connections, or
+// the default automatic connections from another thread, since signals are
+// emitted from the worker threads.
+
+#ifndef QMETA_BATCH_EXTRACTOR_H_
+#define QMETA_BATCH_EXTRACTOR_H_
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QScopedPointer>
+#include <QStringList>
+
+#include "qmeta/file.h"
+
+class QSemaphore;
+class QThreadPool;
+
+namespace qmeta {
+
+class Image;
+
+class BatchExtractor : public QObject {
+  Q_OBJECT
+
+ public:
+  // The orders in which the extracted files are delivered.
+  enum Order {
+    kInOrder = 0,  // The order in which files are found
+    kAsCompleted,  // The order in which files finish parsing
+  };
+
+  explicit BatchExtractor(QObject *parent = NULL);
+  ~BatchExtractor();
+  void AddPath(const QString &path);
+  void AddPaths(const QStringList &paths);
+  void Cancel();
+  bool IsCanceled() const;
+  bool IsRunning() const;
+  void Start();
+  void Wait();
+
+  int max_in_flight() const { return max_in_flight_; }
+  void set_max_in_flight(int count) { max_in_flight_ = qMax(1, count); }
+  int max_thread_count() const { return max_thread_count_; }
+  void set_max_thread_count(int count) { max_thread_count_ = qMax(1, count); }
+  File::Options options() const { return options_; }
+  void set_options(File::Options options) { options_ = options; }
+  Order order() const { return order_; }
+  void set_order(Order order) { order_ = order; }
+  QStringList paths() const { return paths_; }
+
+ signals:
+  // Emitted when the file at the specified index is parsed. The index is the
+  // order in which the file was found. The image is NULL if the file is not
+  // a supported image, otherwise the receiver takes the ownership of the
+  // image, which lives in the thread of this object.
+  void Extracted(int index, const QString &file_name, qmeta::Image *image);
+  // Emitted after each file is parsed. The dispatched_count keeps growing
+  // while directories are being searched.
+  void Progress(int completed_count, int dispatched_count);
+  // Emitted when all found files are parsed or the extraction is canceled.
+  void Finished();
+
+ private:
+  class DispatchThread;
+  class ExtractTask;
+
+  // A parsed file waiting for delivery.
+  typedef QPair<QString, Image*> Result;
+
+  void Complete(int index, const QString &file_name, Image *image);
+  void Deliver(int index, const QString &file_name, Image *image);
+  void Dispatch();
+  void DispatchFile(int index, const QString &file_name);
+  void Extract(int index, const QString &file_name);
+
+  // Set to non-zero when the extraction is canceled.
+  QAtomicInt canceled_;
+  // The number of files finished parsing.
+  int completed_count_;
+  // The number of files handed to the thread pool.
+  int dispatched_count_;
+  // Serializes the delivery of parsed files and the signals, so they are
+  // emitted in order without holding mutex_. Locked before mutex_.
+  QMutex delivery_mutex_;
+  // Whether no paths are being searched, which is false from Start() until
+  // all paths are searched.
+  bool dispatch_finished_;
+  // The thread searching paths and dispatching files to the thread pool.
+  DispatchThread *dispatch_thread_;
+  // Limits the number of files parsed or waiting for delivery.
+  QScopedPointer<QSemaphore> in_flight_;
+  // The maximum number of files parsed or waiting for delivery at a time.
+  int max_in_flight_;
+  // The maximum number of threads parsing files at a time.
+  int max_thread_count_;
+  // Guards the delivery state shared by the worker threads.
+  mutable QMutex mutex_;
+  // The index of the next file to deliver if the order is kInOrder.
+  int next_index_;
+  // The options passed to each parsed Image.
+  File::Options options_;
+  // The order in which the extracted files are delivered.
+  Order order_;
+  // The number of dispatched files whose tasks have not returned yet,
+  // including tasks still queued in the thread pool.
+  int outstanding_count_;
+  // The paths to files or directories to extract.
+  QStringList paths_;
+  // The parsed files waiting for files found earlier if the order is
+  // kInOrder, keyed by index.
+  QMap<int, Result> pending_results_;
+  // The thread pool parsing the files.
+  QThreadPool *thread_pool_;
+};
+
+}  // namespace qmeta
+
+#endif  // QMETA_BATCH_EXTRACTOR_H_
@@ -0,0 +1,152 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file defines the functions decoding integers and rationals stored in
+// the specified byte order from raw bytes, and encoding integers back. The
+// byte order of the decoders is a template parameter so each function
+// compiles to a plain load and an optional byte swap without any heap
+// allocation.
+
+#ifndef QMETA_BYTE_ORDER_H_
+#define QMETA_BYTE_ORDER_H_
+
+#include <QtEndian>
+
+#include "qmeta/identifiers.h"
+
+namespace qmeta {
+
+// Decodes a 16-bit unsigned integer from the specified 2 bytes of data.
+template <Endianness kByteOrder> quint16 DecodeUInt16(const char *data);
+
+template <> inline quint16 DecodeUInt16<kBigEndians>(const char *data) {
+  return qFromBigEndian<quint16>(reinterpret_cast<const uchar*>(data));
+}
+
+template <> inline quint16 DecodeUInt16<kLittleEndians>(const char *data) {
+  return qFromLittleEndian<quint16>(reinterpret_cast<const uchar*>(data));
+}
+
+// Decodes a 32-bit unsigned integer from the specified 4 bytes of data.
+template <Endianness kByteOrder> quint32 DecodeUInt32(const char *data);
+
+template <> inline quint32 DecodeUInt32<kBigEndians>(const char *data) {
+  return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(data));
+}
+
+template <> inline quint32 DecodeUInt32<kLittleEndians>(const char *data) {
+  return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(data));
+}
+
+// Decodes a 64-bit unsigned integer from the specified 8 bytes of data.
+template <Endianness kByteOrder> quint64 DecodeUInt64(const char *data);
+
+template <> inline quint64 DecodeUInt64<kBigEndians>(const char *data) {
+  return qFromBigEndian<quint64>(reinterpret_cast<const uchar*>(data));
+}
+
+template <> inline quint64 DecodeUInt64<kLittleEndians>(const char *data) {
+  return qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(data));
+}
+
+// Decodes a 16-bit signed integer from the specified 2 bytes of data.
+template <Endianness kByteOrder> inline qint16 DecodeInt16(const char *data) {
+  return static_cast<qint16>(DecodeUInt16<kByteOrder>(data));
+}
+
+// Decodes a 32-bit signed integer from the specified 4 bytes of data.
+template <Endianness kByteOrder> inline qint32 DecodeInt32(const char *data) {
+  return static_cast<qint32>(DecodeUInt32<kByteOrder>(data));
+}
+
+// Decodes a RATIONAL, which consists of two LONGs, from the specified 8 bytes
+// of data.
+template <Endianness kByteOrder>
+inline void DecodeRational(const char *data, quint32 *numerator,
+                           quint32 *denominator) {
+  *numerator = DecodeUInt32<kByteOrder>(data);
+  *denominator = DecodeUInt32<kByteOrder>(data + 4);
+}
+
+// Decodes a SRATIONAL, which consists of two SLONGs, from the specified 8
+// bytes of data.
+template <Endianness kByteOrder>
+inline void DecodeSRational(const char *data, qint32 *numerator,
+                            qint32 *denominator) {
+  *numerator = DecodeInt32<kByteOrder>(data);
+  *denominator = DecodeInt32<kByteOrder>(data + 4);
+}
+
+// Decodes a 16-bit unsigned integer in the specified byte order, which is
+// only known at runtime.
+inline quint16 DecodeUInt16(const char *data, Endianness byte_order) {
+  if (byte_order == kBigEndians)
+    return DecodeUInt16<kBigEndians>(data);
+  return DecodeUInt16<kLittleEndians>(data);
+}
+
+// Decodes a 32-bit unsigned integer in the specified byte order, which is
+// only known at runtime.
+inline quint32 DecodeUInt32(const char *data, Endianness byte_order) {
+  if (byte_order == kBigEndians)
+    return DecodeUInt32<kBigEndians>(data);
+  return DecodeUInt32<kLittleEndians>(data);
+}
+
+// Decodes a 64-bit unsigned integer in the specified byte order, which is
+// only known at runtime.
+inline quint64 DecodeUInt64(const char *data, Endianness byte_order) {
+  if (byte_order == kBigEndians)
+    return DecodeUInt64<kBigEndians>(data);
+  return DecodeUInt64<kLittleEndians>(data);
+}
+
+// Encodes a 16-bit unsigned integer to the specified 2 bytes of data in the
+// specified byte order.
+inline void EncodeUInt16(quint16 value, Endianness byte_order, char *data) {
+  if (byte_order == kBigEndians)
+    qToBigEndian(value, reinterpret_cast<uchar*>(data));
+  else
+    qToLittleEndian(value, reinterpret_cast<uchar*>(data));
+}
+
+// Encodes a 32-bit unsigned integer to the specified 4 bytes of data in the
+// specified byte order.
+inline void EncodeUInt32(quint32 value, Endianness byte_order, char *data) {
+  if (byte_order == kBigEndians)
+    qToBigEndian(value, reinterpret_cast<uchar*>(data));
+  else
+    qToLittleEndian(value, reinterpret_cast<uchar*>(data));
+}
+
+// Encodes a 64-bit unsigned integer to the specified 8 bytes of data in the
+// specified byte order.
+inline void EncodeUInt64(quint64 value, Endianness byte_order, char *data) {
+  if (byte_order == kBigEndians)
+    qToBigEndian(value, reinterpret_cast<uchar*>(data));
+  else
+    qToLittleEndian(value, reinterpret_cast<uchar*>(data));
+}
+
+}  // namespace qmeta
+
+#endif  // QMETA_BYTE_ORDER_H_
@@ -0,0 +1,89 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file defines the CountingDevice class which forwards all I/O to
+// another QIODevice while recording I/O statistics. The File class tracks
+// its file through a CountingDevice so the I/O of all parsers is recorded.
+// Reads served as views of directly addressable data are recorded by the
+// helpers in io.h. A CountingDevice can also prefetch the beginning of the
+// forwarded device in a single read and serve later reads from it, and it
+// only seeks the forwarded device when reading from it.
+
+#ifndef QMETA_COUNTING_DEVICE_H_
+#define QMETA_COUNTING_DEVICE_H_
+
+#include <QByteArray>
+#include <QIODevice>
+
+namespace qmeta {
+
+// The I/O statistics of one or more files.
+struct IoStatistics {
+  IoStatistics();
+  IoStatistics& operator+=(const IoStatistics &statistics);
+
+  // The number of seeks.
+  qint64 seek_count;
+  // The number of reads.
+  qint64 read_count;
+  // The number of bytes read.
+  qint64 bytes_read;
+  // The largest distance skipped forward by a single seek.
+  qint64 largest_forward_skip;
+  // The number of bytes read by single-byte reads, typically when scanning.
+  qint64 bytes_scanned;
+};
+
+class CountingDevice : public QIODevice {
+  Q_OBJECT
+
+ public:
+  explicit CountingDevice(QIODevice *device, QObject *parent = NULL);
+  ~CountingDevice();
+  void Advance(qint64 size);
+  static IoStatistics GlobalStatistics();
+  bool isSequential() const;
+  void Prefetch(qint64 size);
+  void RecordRead(qint64 size);
+  static void ResetGlobalStatistics();
+  bool seek(qint64 pos);
+  qint64 size() const;
+
+  QIODevice* device() const { return device_; }
+  IoStatistics statistics() const { return statistics_; }
+
+ protected:
+  qint64 readData(char *data, qint64 max_size);
+  qint64 writeData(const char *data, qint64 max_size);
+
+ private:
+  // The forwarded device.
+  QIODevice *device_;
+  // The first bytes of the forwarded device read by Prefetch().
+  QByteArray prefetched_data_;
+  // The I/O statistics recorded since construction.
+  IoStatistics statistics_;
+};
+
+}  // namespace qmeta
+
+#endif  // QMETA_COUNTING_DEVICE_H_
@@ -26,26 +26,39 @@
 #define QMETA_EXIF_H_
 
 #include <QHash>
+#include <QList>
+#include <QVector>
 
 #include "qmeta/exif_data.h"
 #include "qmeta/identifiers.h"
 #include "qmeta/standard.h"
+#include "qmeta/tiff_header.h"
 
 class QIODevice;
 
 namespace qmeta {
 
-class TiffHeader;
-
 class Exif : public Standard {
   Q_OBJECT
 
  public:
+  // The image file directories used in Exif. Tags are scoped by the IFD
+  // containing them since different IFDs may contain the same tag.
+  enum Ifd {
+    kIfd0 = 0,  // The primary image
+    kIfd1,  // The thumbnail image
+    kExifIfd,  // Exif-specific attributes
+    kGpsIfd,  // GPS attributes
+    kInteroperabilityIfd,  // Interoperability attributes
+    kSubIfd0,  // The first SubIFD, the nth SubIFD is kSubIfd0 + n
+  };
+
   enum Tag {
     // Exif-specific IFD.
     kExifIfdPointer = 34665,
     kGpsInfoIfdPointer = 34853,
     kInteroperabilityIfdPointer = 40965,
+    kSubIfds = 330,  // Offsets to SubIFDs such as full-size raw images
 
     // TIFF Rev. 6.0 attribute information used in Exif, represented in decimal.
     // Tags relating to image data structure.
@@ -184,26 +197,34 @@ class Exif : public Standard {
   };
 
   explicit Exif(QObject *parent = NULL);
-  bool Init(QIODevice *file, TiffHeader *tiff_header);
+  bool Init(QIODevice *file, TiffHeader *tiff_header,
+            bool is_thumbnail_only = false);
+  bool IsTruncated() const;
+  int SubIfdCount() const;
+  static QString TagName(Tag tag);
+  static Ifd TagIfd(Tag tag);
+  bool SetValue(Tag tag, const ExifData &value);
+  bool SetValue(Ifd ifd, Tag tag, const ExifData &value);
+  QList<Tag> Tags(Ifd ifd) const;
   QByteArray Thumbnail();
+  bool Thumbnail(QIODevice *output);
+  QByteArray ThumbnailView();
   ExifData Value(Tag tag);
+  ExifData Value(Ifd ifd, Tag tag);
+  ExifData ValueView(Ifd ifd, Tag tag);
 
-  QHash<Tag, QString> tag_names() const { return tag_names_; }
+  QHash<Tag, QString> tag_names() const;
 
  private:
-  void InitTagNames();
-  void ReadIfds(int ifd_offset);
+  bool FindThumbnail(qint64 *offset, qint64 *length);
+  const QVector<TiffHeader::IfdEntry>& IfdEntries(Ifd ifd) const;
+  qint64 ReadIfd(Ifd ifd, qint64 ifd_offset);
 
-  void set_tag_names(QHash<Tag, QString> names) { tag_names_ = names; }
-  QHash<Tag, qint64> tag_offsets() const { return tag_offsets_; }
-  void set_tag_offsets(QHash<Tag, qint64> offsets) { tag_offsets_ = offsets; }
   TiffHeader* tiff_header() const { return tiff_header_; }
   void set_tiff_header(TiffHeader *tiff_header) { tiff_header_ = tiff_header; }
 
-  // The tag names to read for human.
-  QHash<Tag, QString> tag_names_;
-  // Records offsets of tags used in Exif.
-  QHash<Tag, qint64> tag_offsets_;
+  // The decoded entries of each IFD sorted by tag, indexed by Ifd.
+  QVector<QVector<TiffHeader::IfdEntry> > ifd_entries_;
   // Tracks the TiffHeader object.
   TiffHeader *tiff_header_;
 };
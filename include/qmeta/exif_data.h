@@ -28,16 +28,38 @@
 
 #include <QObject>
 
+#include "qmeta/tiff_header.h"
+
 namespace qmeta {
 
+// The byte array is always in the big-endian byte order as returned by
+// TiffHeader::IfdEntryValue(). If the Type and the Count are known, values
+// are decoded according to them, and values at any index can be retrieved
+// for fields with Count > 1 such as GPS latitude. All conversions decode
+// the bytes in place without allocation.
 class ExifData : public QByteArray {
  public:
   ExifData(const QByteArray &other);
-  double ToDouble();
-  float ToFloat();
-  int ToInt();
-  QString ToString();
-  uint ToUInt();
+  ExifData(const QByteArray &other, TiffHeader::Type type, int value_count);
+  double ToDouble(int index = 0) const;
+  float ToFloat(int index = 0) const;
+  int ToInt(int index = 0) const;
+  bool ToRational(int index, quint32 *numerator, quint32 *denominator) const;
+  bool ToSRational(int index, qint32 *numerator, qint32 *denominator) const;
+  QString ToString() const;
+  uint ToUInt(int index = 0) const;
+  quint64 ToUInt64(int index = 0) const;
+
+  TiffHeader::Type type() const { return type_; }
+  int value_count() const { return value_count_; }
+
+ private:
+  const char* ValueData(int index, int unit_size) const;
+
+  // The Type of the value. Set to TiffHeader::kUnknownType if unknown.
+  TiffHeader::Type type_;
+  // The number of values of the Type.
+  int value_count_;
 };
 
 }  // namespace qmeta
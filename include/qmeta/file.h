@@ -26,9 +26,13 @@
 #ifndef QMETA_FILE_H_
 #define QMETA_FILE_H_
 
+#include <QByteArray>
+#include <QIODevice>
 #include <QObject>
 
-class QIODevice;
+#include "qmeta/counting_device.h"
+
+class QFile;
 
 namespace qmeta {
 
@@ -38,14 +42,39 @@ class Xmp;
 
 class File : public QObject {
  public:
-  explicit File(QByteArray *data);
-  explicit File(QIODevice *file);
-  explicit File(const QString &file_name);
+  // The options specifying which metadata should be parsed. Metadata
+  // standards not specified are never parsed, and the specified ones are
+  // parsed on the first access.
+  enum Option {
+    kExifOption = 0x1,  // Parses Exif
+    kIptcOption = 0x2,  // Parses IPTC
+    kXmpOption = 0x4,  // Parses XMP
+    kThumbnailOption = 0x8,  // Parses only IFD1 of Exif for the thumbnail
+    kAllOptions = kExifOption | kIptcOption | kXmpOption | kThumbnailOption,
+    // Also indexes the segments following the image data of JPEG files,
+    // which requires scanning the image data.
+    kTrailingSegmentsOption = 0x10,
+    // Opens files constructed from file names or byte arrays for writing so
+    // metadata can be edited in place. Such files are not memory-mapped.
+    kWritableOption = 0x20,
+  };
+  Q_DECLARE_FLAGS(Options, Option)
+
+  explicit File(QByteArray *data, Options options = kAllOptions);
+  explicit File(QIODevice *file, Options options = kAllOptions);
+  explicit File(const QString &file_name, Options options = kAllOptions);
+  Exif* exif();
+  Iptc* iptc();
+  // Returns true if the tracked file is valid. This function should be
+  // reimplemented in all subclasses to verify specific file types.
+  virtual bool IsValid() { return false; }
   QByteArray Thumbnail();
+  bool Thumbnail(QIODevice *output);
+  QByteArray ThumbnailView();
+  Xmp* xmp();
 
-  Exif* exif() const { return exif_; }
-  Iptc* iptc() const { return iptc_; }
-  Xmp* xmp() const { return xmp_; }
+  IoStatistics io_statistics() const;
+  Options options() const { return options_; }
 
  protected:
   // Initializes the Exif object.
@@ -53,6 +82,7 @@ class File : public QObject {
   virtual void InitIptc() {};
   void InitMetadata();
   virtual void InitXmp() {};
+  void PrefetchHeader();
 
   void set_exif(Exif *exif) { exif_ = exif; }
   QIODevice* file() const { return file_; }
@@ -60,25 +90,37 @@ class File : public QObject {
   void set_xmp(Xmp *xmp) { xmp_ = xmp; }
 
  private:
-  // Returns true if the tracked file is valid. This function should be
-  // reimplemented in all subclasses to verify specific file types.
-  virtual bool IsValid() { return false; }
-
+  void InitStandard(Option standard);
   void set_file(QIODevice *file) { file_ = file; }
+  bool MapFile(QFile *file);
+  QIODevice::OpenMode OpenMode() const;
+  void TrackFile(QIODevice *file);
+  void set_options(Options options) { options_ = options; }
 
   // The corresponded Exif object of the tracked file. This property is set
   // if the tracked file supports the EXIF standard.
   Exif *exif_;
   // Tracks the current opened file.
   QIODevice *file_;
+  // The metadata standards that have been initialized since the last call
+  // to InitMetadata().
+  Options initialized_standards_;
+  // Refers to the memory-mapped content of the file if the file is
+  // constructed from a file name and the mapping succeeded. The tracked
+  // file then reads from a QBuffer over this property.
+  QByteArray mapped_data_;
   // The corresponded Iptc object of the tracked file. This property is set
   // if the tracked file supports the IPTC standard.
   Iptc *iptc_;
+  // The options specifying which metadata should be parsed.
+  Options options_;
   // The corresponded Xmp object of the tracked file. This property is set
   // if the tracked file supports the XMP standard.
   Xmp *xmp_;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(File::Options)
+
 }  // namespace qmeta
 
 #endif  // QMETA_FILE_H_
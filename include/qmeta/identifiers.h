@@ -36,6 +36,13 @@ enum FileType {
   kInvalidFileType = 0,
   kJpegFileType,
   kTiffFileType,
+  // TIFF-based raw formats.
+  kDngFileType,  // Adobe Digital Negative
+  kCr2FileType,  // Canon
+  kNefFileType,  // Nikon
+  kArwFileType,  // Sony
+  kOrfFileType,  // Olympus
+  kPefFileType,  // Pentax
 };
 
 }  // namespace qmeta
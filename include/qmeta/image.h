@@ -32,6 +32,7 @@
 #include "qmeta/identifiers.h"
 #include "qmeta/iptc.h"
 #include "qmeta/jpeg.h"
+#include "qmeta/raw.h"
 #include "qmeta/tiff.h"
 #include "qmeta/xmp.h"
 
@@ -39,19 +40,32 @@ namespace qmeta {
 
 class Image : public File {
 public:
-  explicit Image(QByteArray *data);
-  explicit Image(QIODevice *file);
-  explicit Image(const QString &file_name);
+  explicit Image(QByteArray *data, Options options = kAllOptions);
+  explicit Image(QIODevice *file, Options options = kAllOptions);
+  explicit Image(const QString &file_name, Options options = kAllOptions);
   bool IsValid();
+  QByteArray Preview();
+  bool Preview(QIODevice *output);
+  QByteArray PreviewView();
+  static bool UpdateXmp(const QString &file_name, const QByteArray &metadata);
 
   FileType file_type() const { return file_type_; }
 
  private:
   void GuessType();
-  template<class T> bool GuessType(FileType file_type);
+  void InitExif();
+  void InitIptc();
+  void InitXmp();
+  bool IsTiffBased() const;
 
   void set_file_type(FileType file_type) { file_type_ = file_type; }
+  File* image() const { return image_; }
+  void set_image(File *image) { image_ = image; }
+
   FileType file_type_;
+  // The file object of the guessed file type. Metadata objects are taken
+  // from this object on first access.
+  File *image_;
 };
 
 }  // namespace qmeta
@@ -0,0 +1,88 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file declares the helper functions used by all QMeta classes to read
+// data from the tracked file. If the bytes of the tracked file are directly
+// addressable, such as memory-mapped files or in-memory buffers, the helpers
+// return views into those bytes instead of copies.
+
+#ifndef QMETA_IO_H_
+#define QMETA_IO_H_
+
+#include <QByteArray>
+
+#include "qmeta/byte_order.h"
+#include "qmeta/identifiers.h"
+
+class QIODevice;
+
+namespace qmeta {
+
+qint64 CopyBytes(QIODevice *file, qint64 offset, qint64 size,
+                 QIODevice *output);
+const QByteArray* DirectData(QIODevice *file);
+QByteArray OwnedBytes(QIODevice *file, const QByteArray &bytes);
+QByteArray ReadBytes(QIODevice *file, qint64 max_size);
+QByteArray ReadBytesAt(QIODevice *file, qint64 offset, qint64 max_size);
+qint64 ReadInto(QIODevice *file, char *data, qint64 max_size);
+quint8 ReadUInt8(QIODevice *file, bool *ok = NULL);
+bool WriteBytesAt(QIODevice *file, qint64 offset, const QByteArray &data);
+
+// Reads a 16-bit unsigned integer in the specified byte order from the
+// current position of the specified file. If ok is not NULL, it is set to
+// false if there are not enough bytes. Returns 0 on failure.
+template <Endianness kByteOrder>
+quint16 ReadUInt16(QIODevice *file, bool *ok = NULL) {
+  char data[2];
+  bool success = ReadInto(file, data, 2) == 2;
+  if (ok)
+    *ok = success;
+  return success ? DecodeUInt16<kByteOrder>(data) : 0;
+}
+
+// Reads a 32-bit unsigned integer in the specified byte order from the
+// current position of the specified file. If ok is not NULL, it is set to
+// false if there are not enough bytes. Returns 0 on failure.
+template <Endianness kByteOrder>
+quint32 ReadUInt32(QIODevice *file, bool *ok = NULL) {
+  char data[4];
+  bool success = ReadInto(file, data, 4) == 4;
+  if (ok)
+    *ok = success;
+  return success ? DecodeUInt32<kByteOrder>(data) : 0;
+}
+
+// Reads a 64-bit unsigned integer in the specified byte order from the
+// current position of the specified file. If ok is not NULL, it is set to
+// false if there are not enough bytes. Returns 0 on failure.
+template <Endianness kByteOrder>
+quint64 ReadUInt64(QIODevice *file, bool *ok = NULL) {
+  char data[8];
+  bool success = ReadInto(file, data, 8) == 8;
+  if (ok)
+    *ok = success;
+  return success ? DecodeUInt64<kByteOrder>(data) : 0;
+}
+
+}  // namespace qmeta
+
+#endif  // QMETA_IO_H_
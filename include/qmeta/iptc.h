@@ -25,7 +25,9 @@
 #ifndef QMETA_IPTC_H_
 #define QMETA_IPTC_H_
 
+#include <QByteArray>
 #include <QHash>
+#include <QVector>
 
 #include "standard.h"
 
@@ -37,6 +39,15 @@ class Iptc : public Standard {
   Q_OBJECT
 
  public:
+  // The IIM records. Tags are DataSet numbers of the application record.
+  enum Record {
+    kEnvelopeRecord = 1,
+    kApplicationRecord = 2,
+    kPreObjectDataRecord = 7,
+    kObjectDataRecord = 8,
+    kPostObjectDataRecord = 9,
+  };
+
   // Only contains the list of valid editorial IPTC tags (2:xx).
   enum Tag {
     kRecordVersion = 0,
@@ -98,31 +109,44 @@ class Iptc : public Standard {
     kObjDataPreviewData = 202,
   };
 
+  // Describes the span of a DataSet in the IPTC data.
+  struct DataSet {
+    // The record number.
+    quint8 record;
+    // The DataSet number within the record.
+    quint8 number;
+    // The offset of the DataSet data relative to the beginning of the IPTC
+    // data.
+    int offset;
+    // The size of the DataSet data.
+    int size;
+  };
+
   explicit Iptc(QObject *parent = NULL);
-  bool Init(QIODevice *file, const qint64 file_start_offset);
+  bool Init(QIODevice *file, const qint64 file_start_offset,
+            const qint64 size);
+  static QString TagName(Tag tag);
   QByteArray Value(Tag tag);
+  QByteArray Value(int record, int number);
   QList<QByteArray> Values(Tag tag);
+  QList<QByteArray> Values(int record, int number);
 
-  QHash<Tag, QString> tag_names() const { return tag_names_; }
+  QVector<DataSet> data_sets() const { return data_sets_; }
+  QHash<Tag, QString> tag_names() const;
 
  private:
-  void InitRepeatableTags();
-  void InitTagNames();
-  QByteArray ReadDataSet(int offset);
-  bool ReadRecord();
-
-  QList<Tag> repeatable_tags() const { return repeatable_tags_; }
-  void set_repeatable_tags(QList<Tag> tags) { repeatable_tags_ = tags; }
-  void set_tag_names(QHash<Tag, QString> names) { tag_names_ = names; }
-  QHash<Tag, qint64> tag_offsets() const { return tag_offsets_; }
-  void set_tag_offsets(QHash<Tag, qint64> offsets) { tag_offsets_ = offsets; }
-
-  // Records the repeatable tags.
-  QList<Tag> repeatable_tags_;
-  // The tag names to read for human.
-  QHash<Tag, QString> tag_names_;
-  // Records offsets of tags used in IPTC.
-  QHash<Tag, qint64> tag_offsets_;
+  bool IndexDataSets();
+
+  void set_data_sets(const QVector<DataSet> &data_sets) {
+    data_sets_ = data_sets;
+  }
+
+  // The IPTC data read from the tracked file in one read. It owns its bytes
+  // since values are served from it for the lifetime of this object, and
+  // the file content may be released or changed by then.
+  QByteArray data_;
+  // The spans of all DataSets in the order they appear in data_.
+  QVector<DataSet> data_sets_;
 };
 
 }  // namespace qmeta
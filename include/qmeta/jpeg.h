@@ -25,6 +25,8 @@
 #ifndef QMETA_JPEG_
 #define QMETA_JPEG_
 
+#include <QList>
+
 #include "qmeta/file.h"
 
 class QString;
@@ -33,15 +35,61 @@ namespace qmeta {
 
 class Jpeg : public File {
  public:
-  explicit Jpeg(QByteArray *data);
-  explicit Jpeg(QIODevice *file);
-  explicit Jpeg(const QString &file_name);
+  // The marker codes used in JPEG files. Each marker is prefixed with 0xFF
+  // in the file, only the second byte is listed here.
+  enum Marker {
+    kTEMMarker = 0x01,  // Temporary private use
+    kSOF0Marker = 0xc0,  // Start of frame, baseline DCT
+    kDHTMarker = 0xc4,  // Define Huffman table
+    kRST0Marker = 0xd0,  // Restart interval termination
+    kRST7Marker = 0xd7,
+    kSOIMarker = 0xd8,  // Start of image
+    kEOIMarker = 0xd9,  // End of image
+    kSOSMarker = 0xda,  // Start of scan
+    kDQTMarker = 0xdb,  // Define quantization table
+    kDRIMarker = 0xdd,  // Define restart interval
+    kAPP0Marker = 0xe0,  // JFIF
+    kAPP1Marker = 0xe1,  // Exif and XMP
+    kAPP13Marker = 0xed,  // Photoshop Image Resource Blocks including IPTC
+    kCOMMarker = 0xfe,  // Comment
+  };
+
+  // Describes a marker segment found in the tracked file.
+  struct Segment {
+    // The marker code of the segment.
+    int marker;
+    // The offset of the 0xFF byte preceding the marker code.
+    qint64 offset;
+    // The value of the segment length field, which includes the 2-byte
+    // length field itself but not the marker. Standalone markers such as
+    // SOI and EOI have the length of 0.
+    int length;
+  };
+
+  explicit Jpeg(QByteArray *data, Options options = kAllOptions);
+  explicit Jpeg(QIODevice *file, Options options = kAllOptions);
+  explicit Jpeg(const QString &file_name, Options options = kAllOptions);
+  void Init();
   bool IsValid();
 
+  QList<Segment> segments() const { return segments_; }
+
  private:
+  friend class JpegRewriter;
+
+  qint64 FindMarker(qint64 offset);
   void InitExif();
   void InitIptc();
+  void InitSegments();
   void InitXmp();
+
+  void set_segments(const QList<Segment> &segments) { segments_ = segments; }
+
+  // The marker segments of the tracked file from the SOI marker up to the
+  // SOS marker, or up to the last trailing segment if
+  // kTrailingSegmentsOption is specified, in the order they appear in the
+  // file.
+  QList<Segment> segments_;
 };
 
 }  // namespace qmeta
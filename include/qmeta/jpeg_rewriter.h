@@ -0,0 +1,98 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file defines the JpegRewriter class which writes a copy of a JPEG
+// file with replaced or removed Exif, IPTC, and XMP segments. The rewriter
+// works on the segment index of the Jpeg class: the new metadata segments
+// are emitted in place of the old ones, and all other segments and the
+// entropy-coded data are copied in large blocks without being decoded or
+// buffered as a whole.
+
+#ifndef QMETA_JPEG_REWRITER_H_
+#define QMETA_JPEG_REWRITER_H_
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+#include "qmeta/jpeg.h"
+
+class QIODevice;
+class QString;
+
+namespace qmeta {
+
+class JpegRewriter {
+ public:
+  explicit JpegRewriter(Jpeg *jpeg);
+  explicit JpegRewriter(const QString &file_name);
+  ~JpegRewriter();
+  bool IsValid() const;
+  void RemoveExif();
+  void RemoveIptc();
+  void RemoveXmp();
+  void SetExif(const QByteArray &tiff_data);
+  void SetIptc(const QByteArray &iptc_data);
+  void SetXmp(const QByteArray &packet);
+  bool Write(QIODevice *output);
+  bool Write(const QString &file_name);
+
+ private:
+  // The kinds of metadata segments the rewriter can replace.
+  enum Kind {
+    kExifKind,
+    kXmpKind,
+    kIptcKind,
+    kOtherKind,
+  };
+
+  // Describes a piece of the output, either a range of the source file or
+  // literal bytes.
+  struct Block {
+    // The offset of the range in the source file, or -1 for literal bytes.
+    qint64 offset;
+    // The size of the range.
+    qint64 size;
+    // The literal bytes if the offset is -1.
+    QByteArray data;
+  };
+
+  static void AppendLiteral(const QByteArray &data, QList<Block> *blocks);
+  static void AppendRange(qint64 offset, qint64 size, QList<Block> *blocks);
+  Kind Classify(const Jpeg::Segment &segment) const;
+  bool MakeSegment(Kind kind, const QByteArray &data,
+                   const Jpeg::Segment *segment, QByteArray *bytes) const;
+  bool Plan(QList<Block> *blocks) const;
+
+  // The Jpeg object whose file is rewritten.
+  Jpeg *jpeg_;
+  // The Jpeg object created by the rewriter, or NULL if jpeg_ is owned by
+  // the caller.
+  Jpeg *owned_jpeg_;
+  // The new payloads of the replaced kinds excluding the signatures. An
+  // empty payload removes the segments of the kind.
+  QHash<int, QByteArray> replacements_;
+};
+
+}  // namespace qmeta
+
+#endif  // QMETA_JPEG_REWRITER_H_
@@ -1,10 +1,16 @@
+#include "batch_extractor.h"
+#include "byte_order.h"
+#include "counting_device.h"
 #include "exif.h"
 #include "exif_data.h"
 #include "file.h"
 #include "identifiers.h"
 #include "image.h"
+#include "io.h"
 #include "iptc.h"
 #include "jpeg.h"
+#include "jpeg_rewriter.h"
+#include "raw.h"
 #include "standard.h"
 #include "tiff.h"
 #include "tiff_header.h"
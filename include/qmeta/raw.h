@@ -0,0 +1,81 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file defines the Raw class for TIFF-based raw image files such as
+// DNG, CR2, NEF, ARW, ORF and PEF. A Raw object behaves as a Tiff object,
+// additionally identifies the raw format, and locates the largest embedded
+// JPEG preview without reading the raw sensor data.
+
+#ifndef QMETA_RAW_H_
+#define QMETA_RAW_H_
+
+#include <QList>
+#include <QPair>
+#include <QVector>
+
+#include "qmeta/identifiers.h"
+#include "qmeta/tiff.h"
+#include "qmeta/tiff_header.h"
+
+class QString;
+
+namespace qmeta {
+
+class Raw : public Tiff {
+ public:
+  explicit Raw(QByteArray *data, Options options = kAllOptions);
+  explicit Raw(QIODevice *file, Options options = kAllOptions);
+  explicit Raw(const QString &file_name, Options options = kAllOptions);
+  QByteArray Preview();
+  bool Preview(QIODevice *output);
+  QByteArray PreviewView();
+
+  FileType file_type() const { return file_type_; }
+
+ private:
+  // The lengths and offsets of embedded JPEG previews.
+  typedef QList<QPair<qint64, qint64> > PreviewList;
+
+  void AppendMakerNotePreviews(const TiffHeader::IfdEntry &maker_note,
+                               PreviewList *previews);
+  void AppendPreview(qint64 offset, qint64 length, PreviewList *previews);
+  void AppendPreviews(const QVector<TiffHeader::IfdEntry> &entries,
+                      PreviewList *previews);
+  bool FindPreview(qint64 *offset, qint64 *length);
+  void GuessFileType();
+
+  void set_file_type(FileType file_type) { file_type_ = file_type; }
+
+  // The raw format of the tracked file, kTiffFileType if the tracked file is
+  // a TIFF file of no known raw format.
+  FileType file_type_;
+  // Whether FindPreview() has looked for the preview.
+  bool is_preview_searched_;
+  // The length of the largest embedded JPEG preview, or 0 if there is none.
+  qint64 preview_length_;
+  // The offset of the largest embedded JPEG preview in the tracked file.
+  qint64 preview_offset_;
+};
+
+}  // namespace qmeta
+
+#endif  // QMETA_RAW_H_
@@ -25,28 +25,34 @@
 #ifndef QMETA_TIFF_H_
 #define QMETA_TIFF_H_
 
+#include <QList>
+
 #include "qmeta/file.h"
+#include "qmeta/tiff_header.h"
 
 class QString;
 
 namespace qmeta {
 
-class TiffHeader;
-
 class Tiff : public File {
  public:
-  explicit Tiff(QByteArray *data);
-  explicit Tiff(QIODevice *file);
-  explicit Tiff(const QString &file_name);
+  explicit Tiff(QByteArray *data, Options options = kAllOptions);
+  explicit Tiff(QIODevice *file, Options options = kAllOptions);
+  explicit Tiff(const QString &file_name, Options options = kAllOptions);
+  QList<TiffHeader::IfdNode> Ifds();
   void Init();
   bool IsValid();
+  int PageCount();
+
+ protected:
+  TiffHeader* tiff_header() const { return tiff_header_; }
 
  private:
+  qint64 FindIfdEntryOffset(int tag, qint64 *size = NULL);
   void InitExif();
   void InitIptc();
   void InitXmp();
 
-  TiffHeader* tiff_header() const { return tiff_header_; }
   void set_tiff_header(TiffHeader *tiff_header) { tiff_header_ = tiff_header; }
 
   // Tracks the TiffHeader object of the tracked file.
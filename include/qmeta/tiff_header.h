@@ -23,13 +23,17 @@
 // This file defines the TiffHeader class which is used for TIFF files and
 // Exif metadata embeded in JPEG files. Both the Tiff and the Jpeg classes
 // should instantiate the TiffHeader object and pass it to the corresponded
-// Exif object.
+// Exif object. Both classic TIFF and BigTIFF structures are supported, and
+// all offsets are 64-bit.
 
 #ifndef QMETA_TIFF_HEADER_H_
 #define QMETA_TIFF_HEADER_H_
 
 #include <QHash>
+#include <QList>
 #include <QObject>
+#include <QSet>
+#include <QVector>
 
 #include "qmeta/identifiers.h"
 
@@ -43,6 +47,8 @@ class TiffHeader : public QObject {
  public:
   // The value data types used in TIFF header.
   enum Type {
+    // Used if the type is not known.
+    kUnknownType = 0,
     // An 8-bit unsigned integer.
     kByteType = 1,
     // An 8-bit byte containing one 7-bit ASCII code. The final byte is
@@ -70,38 +76,134 @@ class TiffHeader : public QObject {
     kFloat = 11,
     // An 8-byte IEEE floating point value.
     kDouble = 12,
+    // A 32-bit (4-byte) unsigned integer holding the offset of an IFD.
+    kIfdType = 13,
+    // A 64-bit (8-byte) unsigned integer, used in BigTIFF.
+    kLong8Type = 16,
+    // A 64-bit (8-byte) signed integer, used in BigTIFF.
+    kSLong8Type = 17,
+    // A 64-bit (8-byte) unsigned integer holding the offset of an IFD, used
+    // in BigTIFF.
+    kIfd8Type = 18,
+  };
+
+  // Bounds the work done on the TIFF structure of a file, so crafted files
+  // can neither make the parser loop forever nor allocate without bound.
+  struct Limits {
+    Limits();
+
+    // The maximum number of IFDs visited by a walk.
+    int max_ifd_count;
+    // The maximum number of entries decoded by a walk.
+    int max_entry_count;
+    // The maximum depth of IFDs reached through IFD pointers. IFDs in the
+    // chain starting from the first IFD have the depth of 0.
+    int max_depth;
+    // The maximum number of bytes of entry values read from the tracked
+    // file since the last call to Init() or Walk(). Values exceeding the
+    // remaining budget are not read.
+    qint64 max_value_size;
+  };
+
+  // A decoded IFD entry.
+  struct IfdEntry {
+    // The tag identifying the field.
+    quint16 tag;
+    // The field type.
+    Type type;
+    // The number of values of the field type.
+    quint64 count;
+    // The raw value field in the byte order of the file, which is 4 bytes
+    // in TIFF and 8 bytes in BigTIFF. It contains the value itself if the
+    // value fits in the field, otherwise the offset of the value relative to
+    // the beginning of the TIFF header. Unused bytes are 0.
+    char value_field[8];
+    // The offset of the entry in the tracked file.
+    qint64 offset;
+  };
+
+  // An IFD visited by Walk().
+  struct IfdNode {
+    // The offset of the IFD in the tracked file.
+    qint64 offset;
+    // The index of the IFD containing the pointer to this IFD in the
+    // result of Walk(), or -1 if the IFD is in the chain starting from the
+    // first IFD.
+    int parent;
+    // The tag of the entry pointing to this IFD, or 0 if the IFD is in the
+    // chain starting from the first IFD.
+    int parent_tag;
+    // The number of IFD pointers followed to reach this IFD.
+    int depth;
+    // The decoded entries of the IFD sorted by tag.
+    QVector<IfdEntry> entries;
   };
 
   explicit TiffHeader(QObject *parent = NULL);
+  int ChainLength();
+  static const IfdEntry* FindIfdEntry(const QVector<IfdEntry> &entries,
+                                      int tag);
   bool HasNextIfdEntry();
   int IfdEntryTag(qint64 ifd_entry_offset);
   Type IfdEntryType(qint64 ifd_entry_offset);
   QByteArray IfdEntryValue(qint64 ifd_entry_offset);
+  QByteArray IfdEntryValue(const IfdEntry &entry);
   qint64 IfdEntryOffset(qint64 ifd_entry_offset);
+  qint64 IfdEntryOffset(const IfdEntry &entry);
+  qint64 IfdEntryValueSize(const IfdEntry &entry);
   bool Init(QIODevice *file, qint64 file_start_offset);
   qint64 NextIfdEntryOffset();
+  qint64 NextIfdOffset(qint64 ifd_offset);
+  QVector<IfdEntry> ReadIfd(qint64 ifd_offset, qint64 *next_ifd_offset = NULL);
+  bool ReserveValue(qint64 offset, qint64 size);
+  bool SetIfdEntryValue(IfdEntry *entry, const QByteArray &value,
+                        quint64 count);
   void ToFirstIfd();
   void ToIfd(qint64 offset);
+  QList<IfdNode> Walk(const QList<int> &pointer_tags,
+                      int max_chain_length = -1);
 
   qint64 current_ifd_offset() const { return current_ifd_offset_; }
   qint64 file_start_offset() const { return file_start_offset_; }
+  qint64 first_ifd_offset() const { return first_ifd_offset_; }
+  Endianness endianness() const { return endianness_; }
+  bool is_big_tiff() const { return is_big_tiff_; }
+  bool is_truncated() const { return is_truncated_; }
+  Limits limits() const { return limits_; }
+  void set_limits(const Limits &limits) { limits_ = limits; }
 
  private:
+  void DecodeIfdEntries(const char *data, int count, qint64 offset,
+                        QVector<IfdEntry> *entries) const;
+  template <Endianness kByteOrder, bool kIsBigTiff>
+  static void DecodeIfdEntries(const char *data, int count, qint64 offset,
+                               QVector<IfdEntry> *entries);
+  qint64 DecodeOffset(const char *data) const;
+  int EntryCountSize() const;
+  int EntrySize() const;
   void InitTypeByteUnit();
-  QByteArray ReadFromFile(const int max_size);
+  bool IsInFile(qint64 offset, qint64 size) const;
+  int OffsetSize() const;
+  qint64 ReadEntryCount(qint64 ifd_offset);
+  QByteArray ReadIfdEntry(qint64 ifd_entry_offset);
+  quint16 ReadUInt16();
+  quint32 ReadUInt32();
+  quint64 ReadUInt64();
+  static QByteArray ToBigEndian(const QByteArray &data, int unit_size);
+  int ValueUnitSize(Type type);
 
   int current_entry_count() const { return current_entry_count_; }
   void set_current_entry_count(int count) { current_entry_count_ = count; }
   int current_entry_number() const { return current_entry_number_; }
   void set_current_entry_number(int number) { current_entry_number_ = number; }
   void set_current_ifd_offset(qint64 offset) { current_ifd_offset_ = offset; }
-  Endianness endianness() const { return endianness_; }
+  void set_big_tiff(bool big_tiff) { is_big_tiff_ = big_tiff; }
   void set_endianness(Endianness endian) { endianness_ = endian; }
   QIODevice* file() const { return file_; }
   void set_file(QIODevice *file) { file_ = file; }
   void set_file_start_offset(qint64 offset) { file_start_offset_ = offset; }
-  int first_ifd_offset() const { return first_ifd_offset_; }
-  void set_first_ifd_offset(int offset) { first_ifd_offset_ = offset; }
+  void set_first_ifd_offset(qint64 offset) { first_ifd_offset_ = offset; }
+  void set_truncated(bool truncated) { is_truncated_ = truncated; }
   QHash<Type, int> type_byte_unit() const { return type_byte_unit_; }
   void set_type_byte_unit(QHash<Type, int> unit) { type_byte_unit_ = unit; }
 
@@ -110,15 +212,29 @@ class TiffHeader : public QObject {
   // The number of current directory entry in the IFD.
   int current_entry_number_;
   // Tracks the beginning offset of current IFD.
-  int current_ifd_offset_;
+  qint64 current_ifd_offset_;
   // The byte order of the TIFF file.
   Endianness endianness_;
   // The tracked file.
   QIODevice *file_;
   // The beginning offset of the TIFF header in the tracked file.
   qint64 file_start_offset_;
-  // The offset of the first IFD.
-  int first_ifd_offset_;
+  // The offset of the first IFD in the tracked file.
+  qint64 first_ifd_offset_;
+  // Whether the TIFF structure is BigTIFF, which uses 8-byte offsets,
+  // 8-byte entry counts, and 20-byte IFD entries.
+  bool is_big_tiff_;
+  // Whether any structure was skipped because it exceeded the tracked file,
+  // formed a cycle, or exceeded the limits.
+  bool is_truncated_;
+  // The limits of the work done on the TIFF structure.
+  Limits limits_;
+  // The number of bytes of entry values read from the tracked file since
+  // the last call to Init() or Walk().
+  qint64 value_size_;
+  // The IFDs visited by NextIfdEntryOffset() since the last call to
+  // ToFirstIfd(), which are not jumped to again.
+  QSet<qint64> visited_ifd_offsets_;
   // The byte unit for each entry type.
   QHash<Type, int> type_byte_unit_;
 };
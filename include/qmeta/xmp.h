@@ -25,11 +25,15 @@
 #ifndef QMETA_XMP_H_
 #define QMETA_XMP_H_
 
+#include <QByteArray>
 #include <QHash>
+#include <QString>
+#include <QStringList>
 
 #include "qmeta/standard.h"
 
 class QIODevice;
+class QXmlStreamReader;
 
 namespace qmeta {
 
@@ -37,8 +41,69 @@ class Xmp : public Standard {
   Q_OBJECT
 
  public:
+  // The types of XMP property values.
+  enum PropertyType {
+    kInvalidProperty,  // The property does not exist
+    kSimpleProperty,
+    kBagProperty,  // Unordered array
+    kSeqProperty,  // Ordered array
+    kAltProperty,  // Alternative array such as language alternatives
+    kStructProperty,
+  };
+
   explicit Xmp(QObject *parent = NULL);
-  bool Init(QIODevice *file, qint64 file_start_offset);
+  QString FieldValue(const QString &namespace_uri, const QString &name,
+                     const QString &field_namespace_uri,
+                     const QString &field_name);
+  bool Init(QIODevice *file, qint64 file_start_offset, qint64 packet_size);
+  QByteArray Packet();
+  QByteArray PacketView();
+  static QByteArray Serialize(const QByteArray &metadata,
+                              qint64 packet_size = 0);
+  PropertyType Type(const QString &namespace_uri, const QString &name);
+  bool Update(const QByteArray &metadata);
+  QString Value(const QString &namespace_uri, const QString &name);
+  QStringList Values(const QString &namespace_uri, const QString &name);
+
+  bool is_writable() const { return is_writable_; }
+  qint64 packet_size() const { return packet_size_; }
+
+ private:
+  // Describes a parsed property.
+  struct Property {
+    // The type of the property value.
+    PropertyType type;
+    // The value of a simple property or the items of an array property.
+    // Empty for struct properties, whose fields are indexed separately.
+    QStringList values;
+  };
+
+  const Property* FindProperty(const QString &key);
+  static QString Key(const QString &namespace_uri, const QString &name);
+  void Parse();
+  void ParseArray(QXmlStreamReader *reader, const QString &key,
+                  PropertyType type);
+  void ParseFields(QXmlStreamReader *reader, const QString &prefix);
+  void ParseProperty(QXmlStreamReader *reader, const QString &key);
+
+  void set_packet_size(qint64 size) { packet_size_ = size; }
+  void set_writable(bool writable) { is_writable_ = writable; }
+
+  // Whether the packet has been parsed into properties_.
+  bool is_parsed_;
+  // Whether the packet may be updated in place. This is false if the
+  // wrapper trailer is <?xpacket end="r"?>.
+  bool is_writable_;
+
+  // The number of bytes reserved for the packet in the tracked file,
+  // including the wrapper and the padding. An updated packet must fit in
+  // these bytes to be written in place.
+  qint64 packet_size_;
+  // The parsed properties keyed by their expanded names, which are the
+  // namespace URIs followed by the local names. Fields of struct
+  // properties are keyed by the key of the struct, a slash, and the
+  // expanded name of the field.
+  QHash<QString, Property> properties_;
 };
 
 }  // namespace qmeta
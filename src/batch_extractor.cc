@@ -0,0 +1,260 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the detail of the BatchExtractor class.
+
+#include "qmeta/batch_extractor.h"
+
+#include <QtCore>
+
+#include "qmeta/image.h"
+
+namespace qmeta {
+
+// The thread searching the paths of a BatchExtractor object.
+class BatchExtractor::DispatchThread : public QThread {
+ public:
+  explicit DispatchThread(BatchExtractor *extractor)
+      : QThread(extractor), extractor_(extractor) {}
+
+ protected:
+  // Reimplements the QThread::run().
+  void run() { extractor_->Dispatch(); }
+
+ private:
+  // The extractor owning this thread.
+  BatchExtractor *extractor_;
+};
+
+// Parses a single file in the thread pool of a BatchExtractor object.
+class BatchExtractor::ExtractTask : public QRunnable {
+ public:
+  ExtractTask(BatchExtractor *extractor, int index, const QString &file_name)
+      : extractor_(extractor), file_name_(file_name), index_(index) {}
+
+  // Reimplements the QRunnable::run().
+  void run() { extractor_->Extract(index_, file_name_); }
+
+ private:
+  // The extractor dispatching this task.
+  BatchExtractor *extractor_;
+  // The path to the file to parse.
+  QString file_name_;
+  // The order in which the file was found.
+  int index_;
+};
+
+BatchExtractor::BatchExtractor(QObject *parent)
+    : QObject(parent), completed_count_(0), dispatched_count_(0),
+      dispatch_finished_(true), max_in_flight_(0), max_thread_count_(0),
+      next_index_(0), options_(File::kAllOptions), order_(kInOrder),
+      outstanding_count_(0) {
+  qRegisterMetaType<Image*>("qmeta::Image*");
+  set_max_thread_count(QThread::idealThreadCount());
+  set_max_in_flight(max_thread_count() * 4);
+  dispatch_thread_ = new DispatchThread(this);
+  thread_pool_ = new QThreadPool(this);
+}
+
+// Cancels the running extraction and waits for it to stop.
+BatchExtractor::~BatchExtractor() {
+  Cancel();
+  Wait();
+}
+
+// Adds the specified path to extract. If the path is a directory, all files
+// in the directory and its subdirectories are extracted.
+void BatchExtractor::AddPath(const QString &path) {
+  paths_.append(path);
+}
+
+// Adds the specified paths to extract. See AddPath().
+void BatchExtractor::AddPaths(const QStringList &paths) {
+  paths_ += paths;
+}
+
+// Cancels the running extraction. Files not parsed yet are skipped, and
+// files already parsed are no longer delivered. The Finished() signal is
+// still emitted.
+void BatchExtractor::Cancel() {
+  canceled_ = 1;
+}
+
+// Handles the parsed file at the specified index. Called by the worker
+// threads. The files ready for delivery are collected under mutex_, and the
+// signals are emitted after unlocking it, so receivers connected directly
+// may call back into this object.
+void BatchExtractor::Complete(int index, const QString &file_name,
+                              Image *image) {
+  QMutexLocker delivery_locker(&delivery_mutex_);
+  QMap<int, Result> ready_results;
+  mutex_.lock();
+  ++completed_count_;
+  if (order() == kAsCompleted) {
+    ready_results.insert(index, Result(file_name, image));
+  } else {
+    pending_results_.insert(index, Result(file_name, image));
+    while (pending_results_.contains(next_index_)) {
+      ready_results.insert(next_index_, pending_results_.take(next_index_));
+      ++next_index_;
+    }
+  }
+  mutex_.unlock();
+
+  QMap<int, Result>::const_iterator iterator = ready_results.constBegin();
+  for (; iterator != ready_results.constEnd(); ++iterator)
+    Deliver(iterator.key(), iterator.value().first, iterator.value().second);
+
+  // The task no longer counts as running once its file is delivered, so
+  // receivers of the signals below see the extraction finished and may
+  // start the next one.
+  mutex_.lock();
+  --outstanding_count_;
+  int completed_count = completed_count_;
+  int dispatched_count = dispatched_count_;
+  bool is_finished = dispatch_finished_ && completed_count == dispatched_count;
+  mutex_.unlock();
+  emit Progress(completed_count, dispatched_count);
+  if (is_finished)
+    emit Finished();
+}
+
+// Delivers the parsed file at the specified index through the Extracted()
+// signal unless the extraction is canceled, and releases its in-flight slot.
+// The caller must hold delivery_mutex_ but not mutex_.
+void BatchExtractor::Deliver(int index, const QString &file_name,
+                             Image *image) {
+  if (IsCanceled())
+    delete image;
+  else
+    emit Extracted(index, file_name, image);
+  in_flight_->release();
+}
+
+// Searches all paths and dispatches the found files to the thread pool.
+// Blocks while max_in_flight() files are being parsed or waiting for
+// delivery. Runs in the dispatch thread.
+void BatchExtractor::Dispatch() {
+  int index = 0;
+  for (int i = 0; i < paths_.count() && !IsCanceled(); ++i) {
+    const QString &path = paths_.at(i);
+    if (!QFileInfo(path).isDir()) {
+      DispatchFile(index++, path);
+      continue;
+    }
+    QDirIterator iterator(path, QDir::Files | QDir::Readable,
+                          QDirIterator::Subdirectories);
+    while (iterator.hasNext() && !IsCanceled())
+      DispatchFile(index++, iterator.next());
+  }
+
+  // Waits for the files being delivered so Finished() is emitted last.
+  QMutexLocker delivery_locker(&delivery_mutex_);
+  mutex_.lock();
+  dispatch_finished_ = true;
+  bool is_finished = completed_count_ == dispatched_count_;
+  mutex_.unlock();
+  if (is_finished)
+    emit Finished();
+}
+
+// Dispatches the file at the specified index to the thread pool once an
+// in-flight slot is available.
+void BatchExtractor::DispatchFile(int index, const QString &file_name) {
+  in_flight_->acquire();
+  mutex_.lock();
+  ++dispatched_count_;
+  ++outstanding_count_;
+  mutex_.unlock();
+  thread_pool_->start(new ExtractTask(this, index, file_name));
+}
+
+// Parses the file at the specified index with all metadata specified in
+// options(), so no parsing is left to the receiving thread. Runs in the
+// thread pool.
+void BatchExtractor::Extract(int index, const QString &file_name) {
+  Image *image = NULL;
+  if (!IsCanceled()) {
+    image = new Image(file_name, options());
+    if (image->IsValid()) {
+      image->exif();
+      image->iptc();
+      image->xmp();
+      image->moveToThread(thread());
+    } else {
+      delete image;
+      image = NULL;
+    }
+  }
+  Complete(index, file_name, image);
+}
+
+// Returns true if the extraction is canceled.
+bool BatchExtractor::IsCanceled() const {
+  return canceled_ != 0;
+}
+
+// Returns true if the extraction is started and not finished yet, which is
+// until paths are no longer searched and every dispatched file, including
+// files still queued in the thread pool, has been delivered. It returns
+// false in receivers of the Finished() signal.
+bool BatchExtractor::IsRunning() const {
+  QMutexLocker locker(&mutex_);
+  return !dispatch_finished_ || outstanding_count_ > 0;
+}
+
+// Starts extracting all added paths and returns immediately. Does nothing if
+// the extraction is already running. May be called from receivers of the
+// Finished() signal to start the next extraction.
+void BatchExtractor::Start() {
+  if (IsRunning())
+    return;
+
+  // The dispatch thread of the last extraction may still be returning from
+  // Dispatch() after searching all paths.
+  dispatch_thread_->wait();
+
+  canceled_ = 0;
+  completed_count_ = 0;
+  dispatched_count_ = 0;
+  dispatch_finished_ = false;
+  next_index_ = 0;
+  pending_results_.clear();
+  in_flight_.reset(new QSemaphore(max_in_flight()));
+  thread_pool_->setMaxThreadCount(max_thread_count());
+  dispatch_thread_->start();
+}
+
+// Blocks until the running extraction is finished. Files parsed before
+// canceling are not delivered, so they are deleted here.
+void BatchExtractor::Wait() {
+  dispatch_thread_->wait();
+  thread_pool_->waitForDone();
+
+  QMutexLocker locker(&mutex_);
+  QMap<int, Result>::const_iterator iterator = pending_results_.constBegin();
+  for (; iterator != pending_results_.constEnd(); ++iterator)
+    delete iterator.value().second;
+  pending_results_.clear();
+}
+
+}  // namespace qmeta
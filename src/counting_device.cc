@@ -0,0 +1,169 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the detail of the CountingDevice class.
+
+#include "qmeta/counting_device.h"
+
+#include <QtCore>
+
+namespace qmeta {
+
+namespace {
+
+// Guards global_statistics.
+QMutex global_statistics_mutex;
+// The statistics of all destroyed CountingDevice objects.
+IoStatistics global_statistics;
+
+}  // namespace
+
+IoStatistics::IoStatistics()
+    : seek_count(0), read_count(0), bytes_read(0), largest_forward_skip(0),
+      bytes_scanned(0) {}
+
+// Adds the specified statistics to this object.
+IoStatistics& IoStatistics::operator+=(const IoStatistics &statistics) {
+  seek_count += statistics.seek_count;
+  read_count += statistics.read_count;
+  bytes_read += statistics.bytes_read;
+  largest_forward_skip = qMax(largest_forward_skip,
+                              statistics.largest_forward_skip);
+  bytes_scanned += statistics.bytes_scanned;
+  return *this;
+}
+
+// Constructs a CountingDevice forwarding to the specified device. The
+// CountingDevice is opened in the same mode as the device if the device is
+// open, and starts at the current position of the device.
+CountingDevice::CountingDevice(QIODevice *device, QObject *parent)
+    : QIODevice(parent), device_(device) {
+  if (device->isOpen() &&
+      open(device->openMode() | QIODevice::Unbuffered) &&
+      !device->isSequential())
+    QIODevice::seek(device->pos());
+}
+
+// Adds the recorded statistics to the global statistics.
+CountingDevice::~CountingDevice() {
+  QMutexLocker locker(&global_statistics_mutex);
+  global_statistics += statistics_;
+}
+
+// Advances the position by the specified size after the caller read the
+// bytes directly from the data of the forwarded device. Records the read
+// but not the seek.
+void CountingDevice::Advance(qint64 size) {
+  RecordRead(size);
+  QIODevice::seek(pos() + size);
+}
+
+// Returns the statistics of all CountingDevice objects destroyed since the
+// last call to ResetGlobalStatistics(). This function is thread-safe.
+IoStatistics CountingDevice::GlobalStatistics() {
+  QMutexLocker locker(&global_statistics_mutex);
+  return global_statistics;
+}
+
+// Reimplements the QIODevice::isSequential().
+bool CountingDevice::isSequential() const {
+  return device_->isSequential();
+}
+
+// Reads the first bytes of the forwarded device up to the specified size in
+// a single read. Later reads within these bytes don't access the forwarded
+// device. Does nothing if the forwarded device is sequential or the bytes
+// are already prefetched.
+void CountingDevice::Prefetch(qint64 size) {
+  if (isSequential() || !prefetched_data_.isEmpty() || size <= 0)
+    return;
+  if (!device_->seek(0))
+    return;
+  prefetched_data_ = device_->read(size);
+  RecordRead(prefetched_data_.size());
+}
+
+// Records a read of the specified size.
+void CountingDevice::RecordRead(qint64 size) {
+  ++statistics_.read_count;
+  if (size <= 0)
+    return;
+  statistics_.bytes_read += size;
+  if (size == 1)
+    ++statistics_.bytes_scanned;
+}
+
+// Resets the global statistics. This function is thread-safe.
+void CountingDevice::ResetGlobalStatistics() {
+  QMutexLocker locker(&global_statistics_mutex);
+  global_statistics = IoStatistics();
+}
+
+// Reimplements the QIODevice::seek(). The forwarded device is seeked on
+// the next read or write at a different position.
+bool CountingDevice::seek(qint64 pos) {
+  ++statistics_.seek_count;
+  statistics_.largest_forward_skip = qMax(statistics_.largest_forward_skip,
+                                          pos - this->pos());
+  if (isSequential())
+    return device_->seek(pos) && QIODevice::seek(pos);
+  return pos <= size() && QIODevice::seek(pos);
+}
+
+// Reimplements the QIODevice::size().
+qint64 CountingDevice::size() const {
+  return device_->size();
+}
+
+// Reimplements the QIODevice::readData(). Bytes within the prefetched data
+// are copied from it, and the rest are read from the forwarded device.
+qint64 CountingDevice::readData(char *data, qint64 max_size) {
+  qint64 pos = this->pos();
+  qint64 size = 0;
+  if (pos < prefetched_data_.size()) {
+    size = qMin(max_size, prefetched_data_.size() - pos);
+    memcpy(data, prefetched_data_.constData() + pos, size);
+  }
+  if (size < max_size) {
+    if (!isSequential() && device_->pos() != pos + size &&
+        !device_->seek(pos + size))
+      return size ? size : -1;
+    qint64 device_size = device_->read(data + size, max_size - size);
+    if (device_size < 0 && size == 0)
+      return -1;
+    size += qMax(static_cast<qint64>(0), device_size);
+  }
+  RecordRead(size);
+  return size;
+}
+
+// Reimplements the QIODevice::writeData(). The prefetched data is dropped
+// since it may no longer match the forwarded device.
+qint64 CountingDevice::writeData(const char *data, qint64 max_size) {
+  prefetched_data_.clear();
+  qint64 pos = this->pos();
+  if (!isSequential() && device_->pos() != pos && !device_->seek(pos))
+    return -1;
+  return device_->write(data, max_size);
+}
+
+}  // namespace qmeta
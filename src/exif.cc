@@ -24,215 +24,524 @@
 
 #include "qmeta/exif.h"
 
+#include <climits>
+
 #include <QtCore>
-#include <qitty/byte_array.h>
 
+#include "qmeta/byte_order.h"
+#include "qmeta/io.h"
 #include "qmeta/tiff_header.h"
 
 namespace qmeta {
 
-Exif::Exif(QObject *parent) : Standard(parent) {
-  InitTagNames();
-  QHash<Tag, qint64> tag_offsets;
-  set_tag_offsets(tag_offsets);
+namespace {
+
+// The metadata of a tag used in Exif.
+struct TagInfo {
+  // The tag number.
+  int tag;
+  // The IFD where the tag is recorded by default.
+  Exif::Ifd ifd;
+  // The untranslated name of the tag to read for human.
+  const char *name;
+};
+
+// The metadata of all tags used in Exif, sorted by tag. This table is shared
+// by all Exif objects, and names are translated only when requested.
+const TagInfo kTagInfos[] = {
+  {Exif::kGPSVersionID, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Version ID")},
+  {Exif::kGPSLatitudeRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Latitude Ref")},
+  {Exif::kGPSLatitude, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Latitude")},
+  {Exif::kGPSLongitudeRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Longitude Ref")},
+  {Exif::kGPSLongitude, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Longitude")},
+  {Exif::kGPSAltitudeRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Altitude Ref")},
+  {Exif::kGPSAltitude, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Altitude")},
+  {Exif::kGPSTimeStamp, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Time Stamp")},
+  {Exif::kGPSSatellites, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Satellites")},
+  {Exif::kGPSStatus, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Status")},
+  {Exif::kGPSMeasureMode, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Measure Mode")},
+  {Exif::kGPSDOP, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS DOP")},
+  {Exif::kGPSSpeedRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Speed Ref")},
+  {Exif::kGPSSpeed, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Speed")},
+  {Exif::kGPSTrackRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Track Ref")},
+  {Exif::kGPSTrack, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Track")},
+  {Exif::kGPSImgDirectionRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Img Direction Ref")},
+  {Exif::kGPSImgDirection, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Img Direction")},
+  {Exif::kGPSMapDatum, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Map Datum")},
+  {Exif::kGPSDestLatitudeRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Latitude Ref")},
+  {Exif::kGPSDestLatitude, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Latitude")},
+  {Exif::kGPSDestLongitudeRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Longitude Ref")},
+  {Exif::kGPSDestLongitude, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Longitude")},
+  {Exif::kGPSDestBearingRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Bearing Ref")},
+  {Exif::kGPSDestBearing, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Bearing")},
+  {Exif::kGPSDestDistanceRef, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Distance Ref")},
+  {Exif::kGPSDestDistance, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Dest Distance")},
+  {Exif::kGPSProcessingMethod, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Processing Method")},
+  {Exif::kGPSAreaInformation, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Area Information")},
+  {Exif::kGPSDateStamp, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Date Stamp")},
+  {Exif::kGPSDifferential, Exif::kGpsIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Differential")},
+  {Exif::kImageWidth, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Image Width")},
+  {Exif::kImageLength, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Image Height")},
+  {Exif::kBitsPerSample, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Bits Per Sample")},
+  {Exif::kCompression, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Compression")},
+  {Exif::kPhotometricInterpretation, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Photometric Interpretation")},
+  {Exif::kImageDescription, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Image Description")},
+  {Exif::kMake, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Make")},
+  {Exif::kModel, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Model")},
+  {Exif::kStripOffsets, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Strip Offsets")},
+  {Exif::kOrientation, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Orientation")},
+  {Exif::kSamplesPerPixel, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Samples Per Pixel")},
+  {Exif::kRowsPerStrip, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Rows Per Strip")},
+  {Exif::kStripByteCounts, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Strip Byte Counts")},
+  {Exif::kXResolution, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "X-Resolution")},
+  {Exif::kYResolution, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Y-Resolution")},
+  {Exif::kPlanarConfiguration, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Planar Configuration")},
+  {Exif::kResolutionUnit, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Resolution Unit")},
+  {Exif::kTransferFunction, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Transfer Function")},
+  {Exif::kSoftware, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Software")},
+  {Exif::kDateTime, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Date Time")},
+  {Exif::kArtist, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Artist")},
+  {Exif::kWhitePoint, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "White Point")},
+  {Exif::kPrimaryChromaticities, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Primary Chromaticities")},
+  {Exif::kSubIfds, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "SubIFDs")},
+  {Exif::kJPEGInterchangeFormat, Exif::kIfd1,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "JPEG Interchange Format")},
+  {Exif::kJPEGInterchangeFormatLength, Exif::kIfd1,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "JPEG Interchange Format Length")},
+  {Exif::kYCbCrCoefficients, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "YCbCr Coefficients")},
+  {Exif::kYCbCrSubSampling, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "YCbCr Sub Sampling")},
+  {Exif::kYCbCrPositioning, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "YCbCr Positioning")},
+  {Exif::kReferenceBlackWhite, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Reference Black White")},
+  {Exif::kCopyright, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Copyright")},
+  {Exif::kExposureTime, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exposure Time")},
+  {Exif::kFNumber, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "F Number")},
+  {Exif::kExifIfdPointer, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exif IFD Pointer")},
+  {Exif::kExposureProgram, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exposure Program")},
+  {Exif::kSpectralSensitivity, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Spectral Sensitivity")},
+  {Exif::kGpsInfoIfdPointer, Exif::kIfd0,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "GPS Info IFD Pointer")},
+  {Exif::kISOSpeedRatings, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "ISO Speed Rating")},
+  {Exif::kOECF, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Optoelectric conversion factor")},
+  {Exif::kExifVersion, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exif Version")},
+  {Exif::kDateTimeOriginal, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Date Time Original")},
+  {Exif::kDateTimeDigitized, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Date Time Digitized")},
+  {Exif::kComponentsConfiguration, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Components Configuration")},
+  {Exif::kCompressedBitsPerPixel, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Compressed Bits Per Pixel")},
+  {Exif::kShutterSpeedValue, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Shutter Speed")},
+  {Exif::kApertureValue, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Aperture Value")},
+  {Exif::kBrightnessValue, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Brightness")},
+  {Exif::kExposureBiasValue, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exposure Bias")},
+  {Exif::kMaxApertureValue, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Maximum Lens Aperture")},
+  {Exif::kSubjectDistance, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Subject Distance")},
+  {Exif::kMeteringMode, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Metering Mode")},
+  {Exif::kLightSource, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Light Source")},
+  {Exif::kFlash, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Flash")},
+  {Exif::kFocalLength, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Focal Length")},
+  {Exif::kSubjectArea, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Subject Area")},
+  {Exif::kMakerNote, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Maker Note")},
+  {Exif::kUserComment, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "User Comment")},
+  {Exif::kSubSecTime, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Sub Sec Time")},
+  {Exif::kSubSecTimeOriginal, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Sub Sec Time Original")},
+  {Exif::kSubSecTimeDigitized, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Sub Sec Time Digitized")},
+  {Exif::kFlashpixVersion, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Flashpix Version")},
+  {Exif::kColorSpace, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Color Space")},
+  {Exif::kPixelXDimension, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Pixel X Dimension")},
+  {Exif::kPixelYDimension, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Pixel Y Dimension")},
+  {Exif::kRelatedSoundFile, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Related Sound File")},
+  {Exif::kInteroperabilityIfdPointer, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Interoperability IFD Pointer")},
+  {Exif::kFlashEnergy, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Flash Energy")},
+  {Exif::kSpatialFrequencyResponse, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Spatial Frequency Response")},
+  {Exif::kFocalPlaneXResolution, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Focal Plane X Resolution")},
+  {Exif::kFocalPlaneYResolution, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Focal Plane Y Resolution")},
+  {Exif::kFocalPlaneResolutionUnit, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Focal Plane Resolution Unit")},
+  {Exif::kSubjectLocation, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Subject Location")},
+  {Exif::kExposureIndex, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exposure Index")},
+  {Exif::kSensingMethod, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Sensing Method")},
+  {Exif::kFileSource, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "File Source")},
+  {Exif::kSceneType, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Scene Type")},
+  {Exif::kCFAPattern, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "CFA Pattern")},
+  {Exif::kCustomRendered, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Custom Rendered")},
+  {Exif::kExposureMode, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Exposure Mode")},
+  {Exif::kWhiteBalance, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "White Balance")},
+  {Exif::kDigitalZoomRatio, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Digital Zoom Ratio")},
+  {Exif::kFocalLengthIn35mmFilm, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Focal Length In 35mm Film")},
+  {Exif::kSceneCaptureType, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Scene Capture Type")},
+  {Exif::kGainControl, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Gain Control")},
+  {Exif::kContrast, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Contrast")},
+  {Exif::kSaturation, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Saturation")},
+  {Exif::kSharpness, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Sharpness")},
+  {Exif::kDeviceSettingDescription, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Device Setting Description")},
+  {Exif::kSubjectDistanceRange, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Subject Distance Range")},
+  {Exif::kImageUniqueID, Exif::kExifIfd,
+   QT_TRANSLATE_NOOP("qmeta::Exif", "Image Unique ID")},
+};
+
+// Returns the metadata of the specified tag, or NULL if the tag is not used
+// in Exif.
+const TagInfo* FindTagInfo(int tag) {
+  int low = 0;
+  int high = sizeof(kTagInfos) / sizeof(kTagInfos[0]) - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    if (kTagInfos[middle].tag < tag)
+      low = middle + 1;
+    else if (kTagInfos[middle].tag > tag)
+      high = middle - 1;
+    else
+      return &kTagInfos[middle];
+  }
+  return NULL;
 }
 
-// Initializes the Exif object.
-bool Exif::Init(QIODevice *file, TiffHeader *tiff_header) {
+}  // namespace
+
+Exif::Exif(QObject *parent) : Standard(parent) {}
+
+// Initializes the Exif object. IFD0 and IFD1 are read from the IFD chain
+// starting at the first IFD, the Exif and GPS IFDs and the SubIFDs are read
+// from the pointers saved in IFD0, and the Interoperability IFD is read from
+// the pointer saved in the Exif IFD, all within the limits of the TiffHeader
+// object.
+// If is_thumbnail_only is true, only IFD1 is read, which is located from the
+// next IFD pointer of IFD0 without decoding the entries of IFD0. Returns
+// false if no IFD contains any entry.
+bool Exif::Init(QIODevice *file, TiffHeader *tiff_header,
+                bool is_thumbnail_only) {
   set_file(file);
   set_tiff_header(tiff_header);
-  tiff_header->ToFirstIfd();
-  ReadIfds(tiff_header->current_ifd_offset());
-  if (tag_offsets().count() == 0)
-    return false;
-  else
-    return true;
-}
+  ifd_entries_.clear();
+  ifd_entries_.resize(kSubIfd0);
 
-// Initializes tag names used in Exif.
-void Exif::InitTagNames() {
-  QHash<Tag, QString> tag_names;
-  // Exif-specific IFD.
-  tag_names.insert(kExifIfdPointer, tr("Exif IFD Pointer"));
-  tag_names.insert(kGpsInfoIfdPointer, tr("GPS Info IFD Pointer"));
-  tag_names.insert(kInteroperabilityIfdPointer,
-                   tr("Interoperability IFD Pointer"));
-  // TIFF Rev. 6.0 attribute information used in Exif.
-  tag_names.insert(kImageWidth, tr("Image Width"));
-  tag_names.insert(kImageLength, tr("Image Height"));
-  tag_names.insert(kBitsPerSample, tr("Bits Per Sample"));
-  tag_names.insert(kCompression, tr("Compression"));
-  tag_names.insert(kPhotometricInterpretation,
-                   tr("Photometric Interpretation"));
-  tag_names.insert(kOrientation, tr("Orientation"));
-  tag_names.insert(kSamplesPerPixel, tr("Samples Per Pixel"));
-  tag_names.insert(kPlanarConfiguration, tr("Planar Configuration"));
-  tag_names.insert(kYCbCrSubSampling, tr("YCbCr Sub Sampling"));
-  tag_names.insert(kYCbCrPositioning, tr("YCbCr Positioning"));
-  tag_names.insert(kXResolution, tr("X-Resolution"));
-  tag_names.insert(kYResolution, tr("Y-Resolution"));
-  tag_names.insert(kResolutionUnit, tr("Resolution Unit"));
-  tag_names.insert(kStripOffsets, tr("Strip Offsets"));
-  tag_names.insert(kRowsPerStrip, tr("Rows Per Strip"));
-  tag_names.insert(kStripByteCounts, tr("Strip Byte Counts"));
-  tag_names.insert(kJPEGInterchangeFormat, tr("JPEG Interchange Format"));
-  tag_names.insert(kJPEGInterchangeFormatLength,
-                   tr("JPEG Interchange Format Length"));
-  tag_names.insert(kTransferFunction, tr("Transfer Function"));
-  tag_names.insert(kWhitePoint, tr("White Point"));
-  tag_names.insert(kPrimaryChromaticities, tr("Primary Chromaticities"));
-  tag_names.insert(kYCbCrCoefficients, tr("YCbCr Coefficients"));
-  tag_names.insert(kReferenceBlackWhite, tr("Reference Black White"));
-  tag_names.insert(kDateTime, tr("Date Time"));
-  tag_names.insert(kImageDescription, tr("Image Description"));
-  tag_names.insert(kMake, tr("Make"));
-  tag_names.insert(kModel, tr("Model"));
-  tag_names.insert(kSoftware, tr("Software"));
-  tag_names.insert(kArtist, tr("Artist"));
-  tag_names.insert(kCopyright, tr("Copyright"));
-  // The attribute information recorded in the Exif IFD.
-  tag_names.insert(kExifVersion, tr("Exif Version"));
-  tag_names.insert(kFlashpixVersion, tr("Flashpix Version"));
-  tag_names.insert(kColorSpace, tr("Color Space"));
-  tag_names.insert(kComponentsConfiguration, tr("Components Configuration"));
-  tag_names.insert(kCompressedBitsPerPixel, tr("Compressed Bits Per Pixel"));
-  tag_names.insert(kPixelXDimension, tr("Pixel X Dimension"));
-  tag_names.insert(kPixelYDimension, tr("Pixel Y Dimension"));
-  tag_names.insert(kMakerNote, tr("Maker Note"));
-  tag_names.insert(kUserComment, tr("User Comment"));
-  tag_names.insert(kRelatedSoundFile, tr("Related Sound File"));
-  tag_names.insert(kDateTimeOriginal, tr("Date Time Original"));
-  tag_names.insert(kDateTimeDigitized, tr("Date Time Digitized"));
-  tag_names.insert(kSubSecTime, tr("Sub Sec Time"));
-  tag_names.insert(kSubSecTimeOriginal, tr("Sub Sec Time Original"));
-  tag_names.insert(kSubSecTimeDigitized, tr("Sub Sec Time Digitized"));
-  tag_names.insert(kExposureTime, tr("Exposure Time"));
-  tag_names.insert(kFNumber, tr("F Number"));
-  tag_names.insert(kExposureProgram, tr("Exposure Program"));
-  tag_names.insert(kSpectralSensitivity, tr("Spectral Sensitivity"));
-  tag_names.insert(kISOSpeedRatings, tr("ISO Speed Rating"));
-  tag_names.insert(kOECF, tr("Optoelectric conversion factor"));
-  tag_names.insert(kShutterSpeedValue, tr("Shutter Speed"));
-  tag_names.insert(kApertureValue, tr("Aperture Value"));
-  tag_names.insert(kBrightnessValue, tr("Brightness"));
-  tag_names.insert(kExposureBiasValue, tr("Exposure Bias"));
-  tag_names.insert(kMaxApertureValue, tr("Maximum Lens Aperture"));
-  tag_names.insert(kSubjectDistance, tr("Subject Distance"));
-  tag_names.insert(kMeteringMode, tr("Metering Mode"));
-  tag_names.insert(kLightSource, tr("Light Source"));
-  tag_names.insert(kFlash, tr("Flash"));
-  tag_names.insert(kFocalLength, tr("Focal Length"));
-  tag_names.insert(kSubjectArea, tr("Subject Area"));
-  tag_names.insert(kFlashEnergy, tr("Flash Energy"));
-  tag_names.insert(kSpatialFrequencyResponse,
-                   tr("Spatial Frequency Response"));
-  tag_names.insert(kFocalPlaneXResolution, tr("Focal Plane X Resolution"));
-  tag_names.insert(kFocalPlaneYResolution, tr("Focal Plane Y Resolution"));
-  tag_names.insert(kFocalPlaneResolutionUnit,
-                   tr("Focal Plane Resolution Unit"));
-  tag_names.insert(kSubjectLocation, tr("Subject Location"));
-  tag_names.insert(kExposureIndex, tr("Exposure Index"));
-  tag_names.insert(kSensingMethod, tr("Sensing Method"));
-  tag_names.insert(kFileSource, tr("File Source"));
-  tag_names.insert(kSceneType, tr("Scene Type"));
-  tag_names.insert(kCFAPattern, tr("CFA Pattern"));
-  tag_names.insert(kCustomRendered, tr("Custom Rendered"));
-  tag_names.insert(kExposureMode, tr("Exposure Mode"));
-  tag_names.insert(kWhiteBalance, tr("White Balance"));
-  tag_names.insert(kDigitalZoomRatio, tr("Digital Zoom Ratio"));
-  tag_names.insert(kFocalLengthIn35mmFilm, tr("Focal Length In 35mm Film"));
-  tag_names.insert(kSceneCaptureType, tr("Scene Capture Type"));
-  tag_names.insert(kGainControl, tr("Gain Control"));
-  tag_names.insert(kContrast, tr("Contrast"));
-  tag_names.insert(kSaturation, tr("Saturation"));
-  tag_names.insert(kSharpness, tr("Sharpness"));
-  tag_names.insert(kDeviceSettingDescription,
-                   tr("Device Setting Description"));
-  tag_names.insert(kSubjectDistanceRange, tr("Subject Distance Range"));
-  tag_names.insert(kImageUniqueID, tr("Image Unique ID"));
-  // The attribute information recorded in the GPS Info IFD.
-  tag_names.insert(kGPSVersionID, tr("GPS Version ID"));
-  tag_names.insert(kGPSLatitudeRef, tr("GPS Latitude Ref"));
-  tag_names.insert(kGPSLatitude, tr("GPS Latitude"));
-  tag_names.insert(kGPSLongitudeRef, tr("GPS Longitude Ref"));
-  tag_names.insert(kGPSLongitude, tr("GPS Longitude"));
-  tag_names.insert(kGPSAltitudeRef, tr("GPS Altitude Ref"));
-  tag_names.insert(kGPSAltitude, tr("GPS Altitude"));
-  tag_names.insert(kGPSTimeStamp, tr("GPS Time Stamp"));
-  tag_names.insert(kGPSSatellites, tr("GPS Satellites"));
-  tag_names.insert(kGPSStatus, tr("GPS Status"));
-  tag_names.insert(kGPSMeasureMode, tr("GPS Measure Mode"));
-  tag_names.insert(kGPSDOP, tr("GPS DOP"));
-  tag_names.insert(kGPSSpeedRef, tr("GPS Speed Ref"));
-  tag_names.insert(kGPSSpeed, tr("GPS Speed"));
-  tag_names.insert(kGPSTrackRef, tr("GPS Track Ref"));
-  tag_names.insert(kGPSTrack, tr("GPS Track"));
-  tag_names.insert(kGPSImgDirectionRef, tr("GPS Img Direction Ref"));
-  tag_names.insert(kGPSImgDirection, tr("GPS Img Direction"));
-  tag_names.insert(kGPSMapDatum, tr("GPS Map Datum"));
-  tag_names.insert(kGPSDestLatitudeRef, tr("GPS Dest Latitude Ref"));
-  tag_names.insert(kGPSDestLatitude, tr("GPS Dest Latitude"));
-  tag_names.insert(kGPSDestLongitudeRef, tr("GPS Dest Longitude Ref"));
-  tag_names.insert(kGPSDestLongitude, tr("GPS Dest Longitude"));
-  tag_names.insert(kGPSDestBearingRef, tr("GPS Dest Bearing Ref"));
-  tag_names.insert(kGPSDestBearing, tr("GPS Dest Bearing"));
-  tag_names.insert(kGPSDestDistanceRef, tr("GPS Dest Distance Ref"));
-  tag_names.insert(kGPSDestDistance, tr("GPS Dest Distance"));
-  tag_names.insert(kGPSProcessingMethod, tr("GPS Processing Method"));
-  tag_names.insert(kGPSAreaInformation, tr("GPS Area Information"));
-  tag_names.insert(kGPSDateStamp, tr("GPS Date Stamp"));
-  tag_names.insert(kGPSDifferential, tr("GPS Differential"));
-  set_tag_names(tag_names);
-}
-
-// Reads all IFDs from the specified ifd_offset and saved
-void Exif::ReadIfds(int ifd_offset) {
-  tiff_header()->ToIfd(ifd_offset);
-
-  QList<qint64> ifd_offsets;
-  // Reads a sequence of 12-byte field entries.
-  while (tiff_header()->HasNextIfdEntry()) {
-    qint64 ifd_entry_offset = tiff_header()->NextIfdEntryOffset();
-    Tag tag = static_cast<Tag>(tiff_header()->IfdEntryTag(ifd_entry_offset));
-
-    if (!tag_names().contains(tag))
-      continue;
-
-    QHash<Tag, qint64> offsets = tag_offsets();
-    offsets.insert(tag, ifd_entry_offset);
-    set_tag_offsets(offsets);
-
-    if (tag == kExifIfdPointer || tag == kGpsInfoIfdPointer) {
-      QByteArray entry_value = tiff_header()->IfdEntryValue(ifd_entry_offset);
-      qint64 ifd_pointer_offset = entry_value.toHex().toUInt(NULL, 16) +
-                                  tiff_header()->file_start_offset();
-      ifd_offsets.append(ifd_pointer_offset);
+  qint64 ifd0_offset = tiff_header->first_ifd_offset();
+  if (is_thumbnail_only) {
+    qint64 ifd1_offset = tiff_header->NextIfdOffset(ifd0_offset);
+    if (ifd1_offset != ifd0_offset)
+      ReadIfd(kIfd1, ifd1_offset);
+  } else {
+    // Walks IFD0, IFD1, and the IFDs pointed to from them iteratively. The
+    // Interoperability IFD is pointed to from the Exif IFD.
+    QList<int> pointer_tags;
+    pointer_tags << kExifIfdPointer << kGpsInfoIfdPointer
+                 << kInteroperabilityIfdPointer << kSubIfds;
+    QList<TiffHeader::IfdNode> nodes = tiff_header->Walk(pointer_tags, 2);
+    int chain_index = 0;
+    int exif_ifd_index = -1;
+    for (int i = 0; i < nodes.count(); ++i) {
+      const TiffHeader::IfdNode &node = nodes.at(i);
+      if (node.parent == -1) {
+        ifd_entries_[chain_index++ == 0 ? kIfd0 : kIfd1] = node.entries;
+      } else if (node.parent == 0 && node.parent_tag == kExifIfdPointer) {
+        ifd_entries_[kExifIfd] = node.entries;
+        exif_ifd_index = i;
+      } else if (node.parent == 0 && node.parent_tag == kGpsInfoIfdPointer) {
+        ifd_entries_[kGpsIfd] = node.entries;
+      } else if (node.parent == exif_ifd_index &&
+                 node.parent_tag == kInteroperabilityIfdPointer) {
+        ifd_entries_[kInteroperabilityIfd] = node.entries;
+      } else if (node.parent == 0 && node.parent_tag == kSubIfds) {
+        ifd_entries_.append(node.entries);
+      }
     }
   }
-  for (int i = 0; i < ifd_offsets.count(); ++i) {
-    ReadIfds(ifd_offsets.at(i));
+
+  for (int i = 0; i < ifd_entries_.count(); ++i) {
+    if (!ifd_entries_.at(i).isEmpty())
+      return true;
   }
+  return false;
+}
+
+// Returns true if any IFD or value was skipped because it exceeded the
+// tracked file, formed a cycle, or exceeded the limits of the TiffHeader
+// object, in which case the parsed metadata is incomplete.
+bool Exif::IsTruncated() const {
+  return tiff_header() && tiff_header()->is_truncated();
+}
+
+// Returns the number of SubIFDs read from IFD0. The nth SubIFD is accessed
+// as kSubIfd0 + n.
+int Exif::SubIfdCount() const {
+  return ifd_entries_.count() - kSubIfd0;
+}
+
+// Returns the decoded entries of the specified IFD sorted by tag.
+const QVector<TiffHeader::IfdEntry>& Exif::IfdEntries(Ifd ifd) const {
+  static const QVector<TiffHeader::IfdEntry> kEmptyEntries;
+  if (ifd < 0 || ifd >= ifd_entries_.count())
+    return kEmptyEntries;
+  return ifd_entries_.at(ifd);
+}
+
+// Reads the IFD at the specified ifd_offset as the specified ifd. Returns the
+// offset of the next IFD, or -1 if there is no next IFD.
+qint64 Exif::ReadIfd(Ifd ifd, qint64 ifd_offset) {
+  if (ifd_offset == -1)
+    return -1;
+  qint64 next_ifd_offset;
+  ifd_entries_[ifd] = tiff_header()->ReadIfd(ifd_offset, &next_ifd_offset);
+  return next_ifd_offset;
+}
+
+// Returns the human-readable names of all tags used in Exif. The names are
+// translated on each call, so prefer TagName() for individual tags.
+QHash<Exif::Tag, QString> Exif::tag_names() const {
+  QHash<Tag, QString> tag_names;
+  int count = sizeof(kTagInfos) / sizeof(kTagInfos[0]);
+  tag_names.reserve(count);
+  for (int i = 0; i < count; ++i)
+    tag_names.insert(static_cast<Tag>(kTagInfos[i].tag), tr(kTagInfos[i].name));
+  return tag_names;
+}
+
+// Returns the translated human-readable name of the specified tag. Returns
+// an empty string if the tag is not used in Exif.
+QString Exif::TagName(Tag tag) {
+  const TagInfo *tag_info = FindTagInfo(tag);
+  if (!tag_info)
+    return QString();
+  return tr(tag_info->name);
+}
+
+// Returns the IFD in which the specified tag is normally saved. Returns
+// kIfd0 if the tag is not used in Exif.
+Exif::Ifd Exif::TagIfd(Tag tag) {
+  const TagInfo *tag_info = FindTagInfo(tag);
+  if (!tag_info)
+    return kIfd0;
+  return tag_info->ifd;
+}
+
+// Sets the value of the specified tag in place. The tag is looked up in the
+// IFD it is normally saved in as returned by TagIfd().
+bool Exif::SetValue(Tag tag, const ExifData &value) {
+  return SetValue(TagIfd(tag), tag, value);
 }
 
-// Returns the byte data of the thumbnail saved in Exif.
+// Sets the value of the specified tag in the specified IFD in place. The
+// tracked file must be writable, and the tag must already exist. The value
+// must be in the big-endian byte order, have the type of the existing entry
+// or TiffHeader::kUnknownType, and a known value count. Only the bytes of the
+// value are written, so the value must fit in the existing entry or in its
+// original value area. Returns false if the value cannot be set in place.
+bool Exif::SetValue(Ifd ifd, Tag tag, const ExifData &value) {
+  if (ifd < 0 || ifd >= ifd_entries_.count())
+    return false;
+  const TiffHeader::IfdEntry *found_entry =
+      TiffHeader::FindIfdEntry(ifd_entries_.at(ifd), tag);
+  if (!found_entry || value.value_count() <= 0)
+    return false;
+  if (value.type() != TiffHeader::kUnknownType &&
+      value.type() != found_entry->type)
+    return false;
+
+  int index = found_entry - ifd_entries_.at(ifd).constData();
+  TiffHeader::IfdEntry entry = *found_entry;
+  if (!tiff_header()->SetIfdEntryValue(&entry, value, value.value_count()))
+    return false;
+  ifd_entries_[ifd][index] = entry;
+  return true;
+}
+
+// Returns all tags saved in the specified IFD in ascending order.
+QList<Exif::Tag> Exif::Tags(Ifd ifd) const {
+  const QVector<TiffHeader::IfdEntry> &entries = IfdEntries(ifd);
+  QList<Tag> tags;
+  tags.reserve(entries.count());
+  for (int i = 0; i < entries.count(); ++i)
+    tags.append(static_cast<Tag>(entries.at(i).tag));
+  return tags;
+}
+
+// Finds the offset and length of the thumbnail saved in IFD1. Returns false
+// if there is no thumbnail or it exceeds the tracked file.
+bool Exif::FindThumbnail(qint64 *offset, qint64 *length) {
+  quint64 thumbnail_offset =
+      ValueView(kIfd1, kJPEGInterchangeFormat).ToUInt64();
+  quint64 thumbnail_length =
+      ValueView(kIfd1, kJPEGInterchangeFormatLength).ToUInt64();
+  if (!thumbnail_offset || !thumbnail_length ||
+      thumbnail_offset > static_cast<quint64>(file()->size()) ||
+      thumbnail_length > static_cast<quint64>(file()->size()))
+    return false;
+  *offset = thumbnail_offset + tiff_header()->file_start_offset();
+  *length = thumbnail_length;
+  return *offset + *length <= file()->size();
+}
+
+// Returns the byte data of the thumbnail saved in Exif. The returned data
+// owns its bytes.
 QByteArray Exif::Thumbnail() {
-  QByteArray thumbnail;
-  quint32 thumbnail_offset = Value(kJPEGInterchangeFormat).ToUInt();
-  quint32 length = Value(kJPEGInterchangeFormatLength).ToUInt();
-  if (thumbnail_offset && length) {
-    thumbnail_offset += tiff_header()->file_start_offset();
-    file()->seek(thumbnail_offset);
-    thumbnail = file()->read(length);
-  }
-  return thumbnail;
+  return OwnedBytes(file(), ThumbnailView());
+}
+
+// Writes the thumbnail saved in Exif to the specified output without
+// holding the whole thumbnail in memory. Returns true if the whole thumbnail
+// is written.
+bool Exif::Thumbnail(QIODevice *output) {
+  qint64 offset;
+  qint64 length;
+  if (!FindThumbnail(&offset, &length))
+    return false;
+  return CopyBytes(file(), offset, length, output) == length;
 }
 
-// Returns the value of the specified tag as a ExifData.
+// Returns the byte data of the thumbnail saved in Exif. The returned data
+// refers to the file content without copying if the file is directly
+// addressable, and is only valid as long as the file object exists and its
+// content is unchanged.
+QByteArray Exif::ThumbnailView() {
+  qint64 offset;
+  qint64 length;
+  if (!FindThumbnail(&offset, &length))
+    return QByteArray();
+  return ReadBytesAt(file(), offset, length);
+}
+
+// Returns the value of the specified tag as a ExifData. The tag is looked up
+// in the IFD it is normally saved in as returned by TagIfd().
 ExifData Exif::Value(Tag tag) {
-  QByteArray value;
-  if (tag_offsets().contains(tag))
-    value = tiff_header()->IfdEntryValue(tag_offsets().value(tag));
-  ExifData exif_data(value);
+  return Value(TagIfd(tag), tag);
+}
+
+// Returns the value of the specified tag in the specified IFD as a ExifData
+// owning its bytes.
+ExifData Exif::Value(Ifd ifd, Tag tag) {
+  ExifData value = ValueView(ifd, tag);
+  return ExifData(OwnedBytes(file(), value), value.type(),
+                  value.value_count());
+}
+
+// Returns the value of the specified tag in the specified IFD as a ExifData.
+// Only the entry table of the specified IFD is searched, and only values not
+// fitting in the entry itself require reading the tracked file. The returned
+// value refers to the file content without copying if the file is directly
+// addressable, and is only valid as long as the file object exists and its
+// content is unchanged.
+ExifData Exif::ValueView(Ifd ifd, Tag tag) {
+  const TiffHeader::IfdEntry *entry =
+      TiffHeader::FindIfdEntry(IfdEntries(ifd), tag);
+  if (!entry)
+    return ExifData(QByteArray());
+  ExifData exif_data(tiff_header()->IfdEntryValue(*entry), entry->type,
+                     static_cast<int>(qMin(entry->count,
+                                           static_cast<quint64>(INT_MAX))));
   return exif_data;
 }
 
@@ -26,42 +26,203 @@
 
 #include <QtCore>
 
+#include "qmeta/byte_order.h"
+
 namespace qmeta {
 
-ExifData::ExifData(const QByteArray &other) : QByteArray(other) {}
+// Constructs the Exif data without knowing its Type and Count. Conversions
+// then assume the Type documented for each function and the Count of 1.
+ExifData::ExifData(const QByteArray &other)
+    : QByteArray(other), type_(TiffHeader::kUnknownType), value_count_(0) {}
+
+// Constructs the Exif data of the specified type and value_count.
+ExifData::ExifData(const QByteArray &other, TiffHeader::Type type,
+                   int value_count)
+    : QByteArray(other), type_(type), value_count_(value_count) {}
+
+// Returns the value at the specified index converted to double. Works for
+// all numeric Types. If the Type is unknown, it is assumed to be RATIONAL.
+double ExifData::ToDouble(int index) const {
+  switch (type()) {
+    case TiffHeader::kSRationalType: {
+      qint32 numerator;
+      qint32 denominator;
+      if (!ToSRational(index, &numerator, &denominator) || denominator == 0)
+        return 0;
+      return static_cast<double>(numerator) / denominator;
+    }
+    case TiffHeader::kSByte:
+    case TiffHeader::kSShort:
+    case TiffHeader::kSLongType:
+      return ToInt(index);
+    case TiffHeader::kByteType:
+    case TiffHeader::kShortType:
+    case TiffHeader::kLongType:
+    case TiffHeader::kIfdType:
+      return ToUInt(index);
+    case TiffHeader::kLong8Type:
+    case TiffHeader::kIfd8Type:
+      return static_cast<double>(ToUInt64(index));
+    case TiffHeader::kSLong8Type:
+      return static_cast<double>(static_cast<qint64>(ToUInt64(index)));
+    case TiffHeader::kFloat: {
+      const char *data = ValueData(index, 4);
+      if (!data)
+        return 0;
+      quint32 bits = DecodeUInt32<kBigEndians>(data);
+      float value;
+      memcpy(&value, &bits, 4);
+      return value;
+    }
+    case TiffHeader::kDouble: {
+      const char *data = ValueData(index, 8);
+      if (!data)
+        return 0;
+      quint64 bits = (static_cast<quint64>(DecodeUInt32<kBigEndians>(data))
+                      << 32) | DecodeUInt32<kBigEndians>(data + 4);
+      double value;
+      memcpy(&value, &bits, 8);
+      return value;
+    }
+    default: {
+      quint32 numerator;
+      quint32 denominator;
+      if (!ToRational(index, &numerator, &denominator) || denominator == 0)
+        return 0;
+      return static_cast<double>(numerator) / denominator;
+    }
+  }
+}
+
+// Returns the value at the specified index converted to float. Works for
+// all numeric Types. If the Type is unknown, it is assumed to be SRATIONAL.
+float ExifData::ToFloat(int index) const {
+  if (type() == TiffHeader::kUnknownType) {
+    qint32 numerator;
+    qint32 denominator;
+    if (!ToSRational(index, &numerator, &denominator) || denominator == 0)
+      return 0;
+    return static_cast<float>(numerator) / denominator;
+  }
+  return static_cast<float>(ToDouble(index));
+}
 
-// Returns the byte array converted to double. This function works correctly
-// if the Type is RATIONAL and the Count is 1.
-double ExifData::ToDouble() {
-  double numerator = static_cast<double>(mid(0,4).toHex().toUInt(NULL, 16));
-  double denominator = static_cast<double>(mid(4).toHex().toUInt(NULL, 16));
-  return numerator/ denominator;
+// Returns the value at the specified index converted to int in decimal. Works
+// for all integer Types. If the Type is unknown, it is assumed to be one of
+// BYTE, SHORT, or SLONG depending on the size.
+int ExifData::ToInt(int index) const {
+  const char *data;
+  switch (type()) {
+    case TiffHeader::kSByte:
+      data = ValueData(index, 1);
+      return data ? static_cast<qint8>(*data) : 0;
+    case TiffHeader::kSShort:
+      data = ValueData(index, 2);
+      return data ? DecodeInt16<kBigEndians>(data) : 0;
+    case TiffHeader::kSLongType:
+      data = ValueData(index, 4);
+      return data ? DecodeInt32<kBigEndians>(data) : 0;
+    case TiffHeader::kUnknownType:
+      if (index == 0 && size() >= 4)
+        return DecodeInt32<kBigEndians>(constData());
+      return ToUInt(index);
+    default:
+      return ToUInt(index);
+  }
 }
 
-// Returns the byte array converted to float. This function works correctly
-// if the Type is SRATIONAL and the Count is 1.
-float ExifData::ToFloat() {
-  float numerator = static_cast<float>(mid(0,4).toHex().toInt(NULL, 16));
-  float denominator = static_cast<float>(mid(4).toHex().toInt(NULL, 16));
-  return numerator/ denominator;
+// Retrieves the RATIONAL value at the specified index. Returns false if the
+// index is out of range.
+bool ExifData::ToRational(int index, quint32 *numerator,
+                          quint32 *denominator) const {
+  const char *data = ValueData(index, 8);
+  if (!data)
+    return false;
+  DecodeRational<kBigEndians>(data, numerator, denominator);
+  return true;
 }
 
-// Returns the byte array converted to int in decimal. This function works
-// correctly if the Type is one of BYTE, SHORT, or SLONG and the Count is 1.
-int ExifData::ToInt() {
-  return toHex().toInt(NULL, 16);
+// Retrieves the SRATIONAL value at the specified index. Returns false if the
+// index is out of range.
+bool ExifData::ToSRational(int index, qint32 *numerator,
+                           qint32 *denominator) const {
+  const char *data = ValueData(index, 8);
+  if (!data)
+    return false;
+  DecodeSRational<kBigEndians>(data, numerator, denominator);
+  return true;
 }
 
 // Returns the byte array converted to QString. This functions works correctly
-// if the Type is ASCII.
-QString ExifData::ToString() {
-  return QString(data());
+// if the Type is ASCII. The byte array may refer to the file content without
+// a terminating null byte, so the conversion is bounded by its size.
+QString ExifData::ToString() const {
+  return QString::fromAscii(constData(), qstrnlen(constData(), size()));
+}
+
+// Returns the value at the specified index converted to uint in decimal.
+// Works for BYTE, SHORT, LONG and UNDEFINED Types. If the Type is unknown,
+// the size of the byte array determines the Type.
+uint ExifData::ToUInt(int index) const {
+  const char *data;
+  switch (type()) {
+    case TiffHeader::kByteType:
+    case TiffHeader::kSByte:
+    case TiffHeader::kUndefinedType:
+      data = ValueData(index, 1);
+      return data ? static_cast<uchar>(*data) : 0;
+    case TiffHeader::kShortType:
+    case TiffHeader::kSShort:
+      data = ValueData(index, 2);
+      return data ? DecodeUInt16<kBigEndians>(data) : 0;
+    case TiffHeader::kLongType:
+    case TiffHeader::kSLongType:
+    case TiffHeader::kIfdType:
+      data = ValueData(index, 4);
+      return data ? DecodeUInt32<kBigEndians>(data) : 0;
+    case TiffHeader::kUnknownType:
+      if (index != 0)
+        return 0;
+      if (size() >= 4)
+        return DecodeUInt32<kBigEndians>(constData());
+      else if (size() >= 2)
+        return DecodeUInt16<kBigEndians>(constData());
+      else if (size() == 1)
+        return static_cast<uchar>(at(0));
+      else
+        return 0;
+    default:
+      return 0;
+  }
+}
+
+// Returns the value at the specified index converted to a 64-bit unsigned
+// integer. Works for all Types supported by ToUInt() and for the 8-byte
+// LONG8, SLONG8, and IFD8 Types of BigTIFF, which are used for offsets and
+// sizes beyond 4 GB.
+quint64 ExifData::ToUInt64(int index) const {
+  switch (type()) {
+    case TiffHeader::kLong8Type:
+    case TiffHeader::kSLong8Type:
+    case TiffHeader::kIfd8Type: {
+      const char *data = ValueData(index, 8);
+      return data ? DecodeUInt64<kBigEndians>(data) : 0;
+    }
+    default:
+      return ToUInt(index);
+  }
 }
 
-// Returns the byte array converted to uint in decimal. This  function works
-// correctly if the Type is BYTE, SHORT, or LONG and the Count is 1.
-uint ExifData::ToUInt() {
-  return toHex().toUInt(NULL, 16);
+// Returns the pointer to the value at the specified index, where each value
+// takes unit_size bytes. Returns NULL if the index is out of range.
+const char* ExifData::ValueData(int index, int unit_size) const {
+  if (index < 0)
+    return NULL;
+  if (type() != TiffHeader::kUnknownType && index >= value_count())
+    return NULL;
+  if ((index + 1) * unit_size > size())
+    return NULL;
+  return constData() + index * unit_size;
 }
 
 }  // namespace qmeta
@@ -24,46 +24,128 @@
 
 #include "qmeta/file.h"
 
+#include <climits>
+
 #include <QtCore>
 
 #include "qmeta/exif.h"
+#include "qmeta/io.h"
 
 namespace qmeta {
 
-// Constructs a file from the given QByteArray data.
-File::File(QByteArray *data) {
-  set_exif(NULL);
-  set_iptc(NULL);
-  set_xmp(NULL);
+namespace {
+
+// The number of bytes read at once from the beginning of files that are not
+// directly addressable. Covers the metadata of most files.
+const qint64 kHeaderPrefetchSize = 64 * 1024;
+
+}  // namespace
+
+// Constructs a file from the given QByteArray data. Only metadata specified
+// in options are parsed. The data is read directly without copying, so it
+// must not be changed or destroyed while this object exists. Results of
+// public getters own their bytes and stay valid afterwards, except those
+// of the ...View() accessors, which refer to the data.
+File::File(QByteArray *data, Options options) {
+  set_options(options);
+  InitMetadata();
   QBuffer *file = new QBuffer(data, this);
-  if (file->open(QIODevice::ReadOnly))
-    set_file(file);
+  if (file->open(OpenMode()))
+    TrackFile(file);
   else
     set_file(NULL);
 }
 
-// Constructs a file from the given QIODevice file.
-File::File(QIODevice *file) {
-  set_exif(NULL);
-  set_iptc(NULL);
-  set_xmp(NULL);
-  set_file(file);
+// Constructs a file from the given QIODevice file. Only metadata specified in
+// options are parsed.
+File::File(QIODevice *file, Options options) {
+  set_options(options);
+  InitMetadata();
+  TrackFile(file);
 }
 
 // Constructs a file and tries to load the file with the given file_name.
-File::File(const QString &file_name) {
-  set_exif(NULL);
-  set_iptc(NULL);
-  set_xmp(NULL);
+// The file is memory-mapped if possible and kWritableOption is not specified
+// so all metadata standards read the mapped bytes directly, otherwise it is
+// read through QFile. Only metadata
+// specified in options are parsed.
+File::File(const QString &file_name, Options options) {
+  set_options(options);
+  InitMetadata();
   QFile *file = new QFile(file_name, this);
-  if (file->open(QIODevice::ReadOnly))
-    set_file(file);
-  else
+  // Opening a missing file for writing would create it, and files are never
+  // created, so missing files are not opened.
+  if ((options & kWritableOption) && !file->exists())
     set_file(NULL);
+  else if (!file->open(OpenMode()))
+    set_file(NULL);
+  else if ((options & kWritableOption) || !MapFile(file))
+    TrackFile(file);
+}
+
+// Maps the whole content of the specified file into memory and tracks a
+// QBuffer reading from the mapping. The mapping lives as long as the file
+// object. Returns false if the file cannot be mapped, e.g. it is empty, it is
+// not a regular file, or it is too large for a QByteArray.
+bool File::MapFile(QFile *file) {
+  qint64 size = file->size();
+  if (size <= 0 || size > INT_MAX)
+    return false;
+
+  uchar *data = file->map(0, size);
+  if (!data)
+    return false;
+
+  mapped_data_ = QByteArray::fromRawData(reinterpret_cast<const char*>(data),
+                                         static_cast<int>(size));
+  QBuffer *buffer = new QBuffer(&mapped_data_, this);
+  if (!buffer->open(QIODevice::ReadOnly)) {
+    delete buffer;
+    mapped_data_.clear();
+    file->unmap(data);
+    return false;
+  }
+  TrackFile(buffer);
+  return true;
+}
+
+// Returns the Exif object of the tracked file, or NULL if the tracked file
+// contains no Exif or neither kExifOption nor kThumbnailOption is specified.
+// Exif is parsed on the first call.
+Exif* File::exif() {
+  InitStandard(kExifOption);
+  return exif_;
+}
+
+// Returns the I/O statistics of all parsers reading the tracked file since
+// this object was constructed.
+IoStatistics File::io_statistics() const {
+  CountingDevice *counting_device = qobject_cast<CountingDevice*>(file());
+  if (!counting_device)
+    return IoStatistics();
+  return counting_device->statistics();
+}
+
+// Returns the mode to open files constructed from file names or byte arrays
+// according to the options. Note that QFile creates a missing file opened
+// in the returned mode if kWritableOption is specified.
+QIODevice::OpenMode File::OpenMode() const {
+  if (options() & kWritableOption)
+    return QIODevice::ReadWrite;
+  return QIODevice::ReadOnly;
+}
+
+// Returns the Iptc object of the tracked file, or NULL if the tracked file
+// contains no IPTC or kIptcOption is not specified. IPTC is parsed on the
+// first call.
+Iptc* File::iptc() {
+  InitStandard(kIptcOption);
+  return iptc_;
 }
 
 // Returns the thumbnail from supported metadata. Currently Exif is the only
-// supported metadata.
+// supported metadata, which is parsed on the first call if needed. The
+// returned thumbnail owns its bytes.
 QByteArray File::Thumbnail() {
   QByteArray thumbnail;
   if (exif())
@@ -71,14 +153,101 @@ QByteArray File::Thumbnail() {
   return thumbnail;
 }
 
-// Initializes metadata objects for the tracked file.
+// Returns the thumbnail like Thumbnail(), but if the tracked file is
+// memory-mapped or constructed from a QByteArray, the returned thumbnail
+// refers to the file content without copying, and is only valid as long as
+// this object exists and the file content is unchanged.
+QByteArray File::ThumbnailView() {
+  QByteArray thumbnail;
+  if (exif())
+    thumbnail = exif()->ThumbnailView();
+  return thumbnail;
+}
+
+// Writes the thumbnail from supported metadata to the specified output
+// without holding the whole thumbnail in memory. Returns true if the whole
+// thumbnail is written.
+bool File::Thumbnail(QIODevice *output) {
+  InitStandard(kExifOption);
+  if (!exif_)
+    return false;
+  return exif_->Thumbnail(output);
+}
+
+// Returns the Xmp object of the tracked file, or NULL if the tracked file
+// contains no XMP or kXmpOption is not specified. XMP is parsed on the first
+// call.
+Xmp* File::xmp() {
+  InitStandard(kXmpOption);
+  return xmp_;
+}
+
+// Resets metadata objects for the tracked file. Each metadata standard is
+// initialized again on the next access.
 void File::InitMetadata() {
+  set_exif(NULL);
+  set_iptc(NULL);
+  set_xmp(NULL);
+  initialized_standards_ = 0;
+}
+
+// Initializes the metadata object of the specified standard if it is
+// enabled by options() and has not been initialized yet. The Exif standard
+// is also enabled by kThumbnailOption.
+void File::InitStandard(Option standard) {
+  if (initialized_standards_ & standard)
+    return;
+
+  Options enabled_options = options();
+  if (enabled_options & kThumbnailOption)
+    enabled_options |= kExifOption;
+  if (!(enabled_options & standard))
+    return;
+
+  initialized_standards_ |= standard;
   if (!IsValid())
     return;
 
-  InitExif();
-  InitIptc();
-  InitXmp();
+  switch (standard) {
+    case kExifOption:
+      InitExif();
+      break;
+    case kIptcOption:
+      InitIptc();
+      break;
+    case kXmpOption:
+      InitXmp();
+      break;
+    default:
+      break;
+  }
+}
+
+// Reads the beginning of the tracked file in a single read so parsing the
+// metadata of most files needs no further I/O. Does nothing if the tracked
+// file is directly addressable.
+void File::PrefetchHeader() {
+  CountingDevice *counting_device = qobject_cast<CountingDevice*>(file());
+  if (counting_device && !DirectData(counting_device))
+    counting_device->Prefetch(kHeaderPrefetchSize);
+}
+
+// Tracks the specified file through a CountingDevice so all I/O on the file
+// is recorded. If the file is already a CountingDevice, e.g. the file of an
+// Image object passed to the guessed file object, it is tracked directly so
+// both objects share the statistics.
+void File::TrackFile(QIODevice *file) {
+  if (!file || qobject_cast<CountingDevice*>(file)) {
+    set_file(file);
+    return;
+  }
+  CountingDevice *counting_device = new CountingDevice(file, this);
+  if (counting_device->isOpen()) {
+    set_file(counting_device);
+  } else {
+    delete counting_device;
+    set_file(file);
+  }
 }
 
 }  // namespace qmeta
@@ -26,52 +26,126 @@
 
 #include <QtCore>
 
+#include "qmeta/io.h"
+#include "qmeta/jpeg_rewriter.h"
+#include "qmeta/raw.h"
+
 namespace qmeta {
 
-Image::Image(QByteArray *data) : File(data) {
+namespace {
+
+// Creates a file object of type T tracking the specified file.
+template<class T> File* CreateFile(QIODevice *file, File::Options options) {
+  return new T(file, options);
+}
+
+// Describes the bytes that a file of a supported file type begins with.
+struct Signature {
+  // The leading bytes of the file.
+  const char *magic;
+  // The number of bytes in magic.
+  int magic_size;
+  // The file type identified by the signature.
+  FileType file_type;
+  // Creates the file object for the file type.
+  File* (*create_file)(QIODevice *file, File::Options options);
+};
+
+// The signatures of all supported file types. Adding a file type only
+// requires a new entry here. TIFF-based files are all created as Raw objects,
+// which tell the actual file type.
+const Signature kSignatures[] = {
+  {"\xff\xd8\xff", 3, kJpegFileType, CreateFile<Jpeg>},
+  {"II\x2a\x00", 4, kTiffFileType, CreateFile<Raw>},
+  {"MM\x00\x2a", 4, kTiffFileType, CreateFile<Raw>},
+  {"II\x2b\x00", 4, kTiffFileType, CreateFile<Raw>},
+  {"MM\x00\x2b", 4, kTiffFileType, CreateFile<Raw>},
+  {"IIRO", 4, kTiffFileType, CreateFile<Raw>},
+  {"IIRS", 4, kTiffFileType, CreateFile<Raw>},
+  {"MMOR", 4, kTiffFileType, CreateFile<Raw>},
+};
+
+// The number of leading bytes needed to match any signature.
+const int kMaxSignatureSize = 16;
+
+// Returns the signature matching the specified header, or NULL if the header
+// matches no supported file type.
+const Signature* FindSignature(const QByteArray &header) {
+  int count = sizeof(kSignatures) / sizeof(kSignatures[0]);
+  for (int i = 0; i < count; ++i) {
+    const Signature &signature = kSignatures[i];
+    if (header.size() >= signature.magic_size &&
+        memcmp(header.constData(), signature.magic,
+               signature.magic_size) == 0)
+      return &signature;
+  }
+  return NULL;
+}
+
+}  // namespace
+
+Image::Image(QByteArray *data, Options options) : File(data, options) {
   GuessType();
 }
 
-Image::Image(QIODevice *file) : File(file) {
+Image::Image(QIODevice *file, Options options) : File(file, options) {
   GuessType();
 }
 
-Image::Image(const QString &file_name) : File(file_name) {
+Image::Image(const QString &file_name, Options options)
+    : File(file_name, options) {
   GuessType();
 }
 
-// Guesses the file type of the tracked file. It calls the GuessType(FileType)
-// function for all file types it guesses. If there is no matched file type
-// or there is no tracked file object, sets the file type to kInvalidFileType.
+// Guesses the file type of the tracked file. Reads the first bytes of the
+// tracked file once and compares them to the signatures of all supported file
+// types, then constructs only the file object of the matched file type. If
+// there is no matched file type, the constructed file object is invalid, or
+// there is no tracked file object, sets the file type to kInvalidFileType.
 void Image::GuessType() {
-  if (file()) {
-    // Guess the file type as JPEG.
-    if (GuessType<Jpeg>(kJpegFileType))
-      return;
-    // Guess the file type as Tiff.
-    else if (GuessType<Tiff>(kTiffFileType))
-      return;
-  }
+  set_image(NULL);
   set_file_type(kInvalidFileType);
-}
+  if (!file())
+    return;
 
-// Guesses the file type of the tracked file. Tries to creates a new image
-// object using the specified type T, if the image is valid, sets the specified
-// file_type to current file type and binds the image's metadata objects.
-// Returns true if the specified type T is correct.
-template<class T> bool Image::GuessType(FileType file_type) {
-  T *image = new T(file());
-  if (image->IsValid()) {
-    image->setParent(this);
-    set_file_type(file_type);
-    set_exif(image->exif());
-    set_iptc(image->iptc());
-    set_xmp(image->xmp());
-    return true;
-  } else {
+  PrefetchHeader();
+  QByteArray header = ReadBytesAt(file(), 0, kMaxSignatureSize);
+  const Signature *signature = FindSignature(header);
+  if (!signature)
+    return;
+
+  File *image = signature->create_file(file(), options());
+  if (!image->IsValid()) {
     delete image;
-    return false;
+    return;
   }
+  image->setParent(this);
+  if (signature->file_type == kTiffFileType)
+    set_file_type(static_cast<Raw*>(image)->file_type());
+  else
+    set_file_type(signature->file_type);
+  set_image(image);
+}
+
+// Reimplements the File::InitExif().
+void Image::InitExif() {
+  set_exif(image()->exif());
+}
+
+// Reimplements the File::InitIptc().
+void Image::InitIptc() {
+  set_iptc(image()->iptc());
+}
+
+// Reimplements the File::InitXmp().
+void Image::InitXmp() {
+  set_xmp(image()->xmp());
+}
+
+// Returns true if the tracked file is TIFF-based, in which case the file
+// object of the guessed file type is a Raw object.
+bool Image::IsTiffBased() const {
+  return file_type() != kInvalidFileType && file_type() != kJpegFileType;
 }
 
 // Reimplements the File::IsValid().
@@ -82,4 +156,52 @@ bool Image::IsValid() {
     return true;
 }
 
+// Returns the byte data of the largest JPEG preview embedded in TIFF-based
+// files, or an empty byte array if there is none or the tracked file is not
+// TIFF-based. The returned data owns its bytes.
+QByteArray Image::Preview() {
+  if (!IsTiffBased())
+    return QByteArray();
+  return static_cast<Raw*>(image())->Preview();
+}
+
+// Writes the largest JPEG preview embedded in TIFF-based files to the
+// specified output. Returns true if the whole preview is written.
+bool Image::Preview(QIODevice *output) {
+  if (!IsTiffBased())
+    return false;
+  return static_cast<Raw*>(image())->Preview(output);
+}
+
+// Returns the preview like Preview(), but if the tracked file is
+// memory-mapped or constructed from a QByteArray, the returned data refers
+// to the file content without copying, and is only valid as long as this
+// object exists and the file content is unchanged.
+QByteArray Image::PreviewView() {
+  if (!IsTiffBased())
+    return QByteArray();
+  return static_cast<Raw*>(image())->PreviewView();
+}
+
+// Replaces the XMP packet of the specified file with a packet wrapping the
+// specified serialized XMP metadata. The packet is written into the
+// reserved bytes of the existing packet, either in the APP1 segment of JPEG
+// files or in the value of tag 700 of TIFF files, if it fits in them. Only
+// JPEG files are rewritten otherwise, or if they have no XMP packet yet.
+// Returns true on success.
+bool Image::UpdateXmp(const QString &file_name, const QByteArray &metadata) {
+  Image image(file_name, kXmpOption | kWritableOption);
+  if (!image.IsValid())
+    return false;
+  Xmp *xmp = image.xmp();
+  if (xmp && xmp->Update(metadata))
+    return true;
+  if (image.file_type() != kJpegFileType)
+    return false;
+
+  JpegRewriter rewriter(static_cast<Jpeg*>(image.image()));
+  rewriter.SetXmp(Xmp::Serialize(metadata));
+  return rewriter.Write(file_name);
+}
+
 }
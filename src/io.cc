@@ -0,0 +1,255 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the I/O helper functions.
+
+#include "qmeta/io.h"
+
+#include <QtCore>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "qmeta/counting_device.h"
+
+namespace qmeta {
+
+namespace {
+
+// The size of the buffer used to copy bytes that are not directly
+// addressable.
+const qint64 kCopyBufferSize = 1024 * 1024;
+
+// Moves the position of the specified file forward by the specified size
+// after reading the bytes directly from its data. If the file is a
+// CountingDevice, the read is recorded.
+void Advance(QIODevice *file, qint64 size) {
+  CountingDevice *counting_device = qobject_cast<CountingDevice*>(file);
+  if (counting_device)
+    counting_device->Advance(size);
+  else
+    file->seek(file->pos() + size);
+}
+
+// Returns the QFile object the specified device reads from, seeing through
+// CountingDevice objects, or NULL if the device is not a QFile.
+QFile* UnderlyingFile(QIODevice *device) {
+  CountingDevice *counting_device = qobject_cast<CountingDevice*>(device);
+  if (counting_device)
+    device = counting_device->device();
+  return qobject_cast<QFile*>(device);
+}
+
+#ifdef Q_OS_LINUX
+// Copies size bytes from the specified offset of the input file descriptor
+// to the current position of the output file descriptor within the kernel.
+// copy_file_range() is preferred since it can share extents on filesystems
+// that support it, sendfile() is used if it is not available. Returns the
+// number of bytes copied.
+qint64 KernelCopy(int input, qint64 offset, qint64 size, int output) {
+  qint64 copied_size = 0;
+  while (copied_size < size) {
+    // Limits each call to 1 GB since sendfile() transfers at most about
+    // 2 GB at once.
+    size_t count = static_cast<size_t>(qMin(size - copied_size,
+                                            Q_INT64_C(1) << 30));
+    ssize_t result = -1;
+#ifdef __NR_copy_file_range
+    loff_t input_offset = offset + copied_size;
+    result = syscall(__NR_copy_file_range, input, &input_offset, output,
+                     NULL, count, 0);
+#endif
+    if (result < 0) {
+      off_t input_offset = offset + copied_size;
+      result = sendfile(output, input, &input_offset, count);
+    }
+    if (result <= 0)
+      break;
+    copied_size += result;
+  }
+  return copied_size;
+}
+#endif
+
+}  // namespace
+
+// Copies size bytes from the specified offset of the specified file to the
+// specified output. If the file content is directly addressable, the bytes
+// are written to the output in one call without copying. On Linux, bytes
+// between two local files are copied within the kernel. Otherwise they are
+// copied through a fixed-size buffer. Returns the number of bytes written,
+// or -1 if nothing could be written.
+qint64 CopyBytes(QIODevice *file, qint64 offset, qint64 size,
+                 QIODevice *output) {
+  const QByteArray *data = DirectData(file);
+  if (data) {
+    QByteArray bytes = ReadBytesAt(file, offset, size);
+    if (bytes.isEmpty())
+      return -1;
+    return output->write(bytes);
+  }
+
+  qint64 copied_size = 0;
+#ifdef Q_OS_LINUX
+  QFile *input_file = UnderlyingFile(file);
+  QFile *output_file = qobject_cast<QFile*>(output);
+  if (input_file && output_file && input_file->handle() >= 0 &&
+      output_file->handle() >= 0 && output_file->flush()) {
+    qint64 output_pos = output_file->pos();
+    copied_size = KernelCopy(input_file->handle(), offset, size,
+                             output_file->handle());
+    // Synchronizes the position of the output with its file descriptor.
+    output_file->seek(output_pos + copied_size);
+    CountingDevice *counting_device = qobject_cast<CountingDevice*>(file);
+    if (counting_device)
+      counting_device->RecordRead(copied_size);
+    if (copied_size == size)
+      return copied_size;
+    offset += copied_size;
+  }
+#endif
+
+  if (!file->seek(offset))
+    return copied_size ? copied_size : -1;
+  QByteArray buffer(static_cast<int>(qMin(size - copied_size,
+                                          kCopyBufferSize)), '\0');
+  while (copied_size < size) {
+    qint64 read_size = ReadInto(file, buffer.data(),
+                                qMin(size - copied_size, kCopyBufferSize));
+    if (read_size <= 0)
+      break;
+    qint64 written_size = output->write(buffer.constData(), read_size);
+    if (written_size <= 0)
+      break;
+    copied_size += written_size;
+    if (written_size < read_size)
+      break;
+  }
+  return copied_size ? copied_size : -1;
+}
+
+// Returns the whole content of the specified file if it can be addressed
+// directly, which is the case for QBuffer objects including the ones created
+// for memory-mapped files, and for CountingDevice objects forwarding to such
+// QBuffer objects. Returns NULL otherwise.
+const QByteArray* DirectData(QIODevice *file) {
+  CountingDevice *counting_device = qobject_cast<CountingDevice*>(file);
+  if (counting_device)
+    file = counting_device->device();
+  QBuffer *buffer = qobject_cast<QBuffer*>(file);
+  if (buffer)
+    return &buffer->data();
+  return NULL;
+}
+
+// Returns the specified bytes read from the specified file as a byte array
+// owning its data. Bytes read from a directly addressable file refer to the
+// file content, so they are copied and stay valid after the file content is
+// released or changed.
+QByteArray OwnedBytes(QIODevice *file, const QByteArray &bytes) {
+  if (!DirectData(file))
+    return bytes;
+  return QByteArray(bytes.constData(), bytes.size());
+}
+
+// Reads at most max_size bytes from the current position of the specified
+// file and advances the position. If the file content is directly addressable,
+// the returned byte array refers to the file content without copying, and it
+// stays valid as long as the file content is unchanged.
+QByteArray ReadBytes(QIODevice *file, qint64 max_size) {
+  const QByteArray *data = DirectData(file);
+  if (!data)
+    return file->read(max_size);
+
+  qint64 pos = file->pos();
+  qint64 size = qMin(max_size, data->size() - pos);
+  if (size <= 0)
+    return QByteArray();
+  Advance(file, size);
+  return QByteArray::fromRawData(data->constData() + pos,
+                                 static_cast<int>(size));
+}
+
+// Reads at most max_size bytes from the specified offset of the specified
+// file. If the file content is directly addressable, the returned byte array
+// refers to the file content without copying and the position of the file is
+// left untouched. Otherwise the file is seeked to the offset and read, with
+// the size clamped to the bytes left in the file so that no larger buffer is
+// allocated.
+QByteArray ReadBytesAt(QIODevice *file, qint64 offset, qint64 max_size) {
+  const QByteArray *data = DirectData(file);
+  if (!data) {
+    qint64 size = qMin(max_size, file->size() - offset);
+    if (offset < 0 || size <= 0 || !file->seek(offset))
+      return QByteArray();
+    return file->read(size);
+  }
+
+  qint64 size = qMin(max_size, data->size() - offset);
+  if (offset < 0 || size <= 0)
+    return QByteArray();
+  CountingDevice *counting_device = qobject_cast<CountingDevice*>(file);
+  if (counting_device)
+    counting_device->RecordRead(size);
+  return QByteArray::fromRawData(data->constData() + offset,
+                                 static_cast<int>(size));
+}
+
+// Reads at most max_size bytes from the current position of the specified
+// file into the specified data without allocating, and advances the
+// position. Returns the number of bytes read, or -1 if an error occurred.
+qint64 ReadInto(QIODevice *file, char *data, qint64 max_size) {
+  const QByteArray *direct_data = DirectData(file);
+  if (!direct_data)
+    return file->read(data, max_size);
+
+  qint64 pos = file->pos();
+  qint64 size = qMin(max_size, direct_data->size() - pos);
+  if (size <= 0)
+    return 0;
+  memcpy(data, direct_data->constData() + pos, size);
+  Advance(file, size);
+  return size;
+}
+
+// Reads a byte from the current position of the specified file. If ok is not
+// NULL, it is set to false if there is no more byte. Returns 0 on failure.
+quint8 ReadUInt8(QIODevice *file, bool *ok) {
+  char data;
+  bool success = ReadInto(file, &data, 1) == 1;
+  if (ok)
+    *ok = success;
+  return success ? static_cast<quint8>(data) : 0;
+}
+
+// Writes the specified data at the specified offset of the specified file.
+// Returns true if all bytes are written.
+bool WriteBytesAt(QIODevice *file, qint64 offset, const QByteArray &data) {
+  if (!file->isWritable() || !file->seek(offset))
+    return false;
+  return file->write(data) == data.size();
+}
+
+}  // namespace qmeta
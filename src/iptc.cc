@@ -26,161 +26,234 @@
 
 #include <QtCore>
 
+#include "qmeta/io.h"
+
 namespace qmeta {
 
-Iptc::Iptc(QObject *parent) : Standard(parent) {
-  InitRepeatableTags();
-  InitTagNames();
+namespace {
+
+// The metadata of a tag used in IPTC.
+struct TagInfo {
+  // The tag number.
+  int tag;
+  // The untranslated name of the tag to read for human.
+  const char *name;
+};
+
+// The metadata of all tags used in IPTC, sorted by tag. This table is shared
+// by all Iptc objects, and names are translated only when requested.
+const TagInfo kTagInfos[] = {
+  {Iptc::kRecordVersion, QT_TRANSLATE_NOOP("qmeta::Iptc", "Record Version")},
+  {Iptc::kObjectTypeReference,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Object Type Reference")},
+  {Iptc::kObjectAttributeReference,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Object Attribute Reference")},
+  {Iptc::kObjectName, QT_TRANSLATE_NOOP("qmeta::Iptc", "Object Name")},
+  {Iptc::kEditStatus, QT_TRANSLATE_NOOP("qmeta::Iptc", "Edit Status")},
+  {Iptc::kEditorialUpdate,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Editorial Update")},
+  {Iptc::kUrgency, QT_TRANSLATE_NOOP("qmeta::Iptc", "Urgency")},
+  {Iptc::kSubjectReference,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Subject Reference")},
+  {Iptc::kCategory, QT_TRANSLATE_NOOP("qmeta::Iptc", "Category")},
+  {Iptc::kSupplementalCategory,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Supplemental Category")},
+  {Iptc::kFixtureIdentifier,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Fixture Identifier")},
+  {Iptc::kKeywords, QT_TRANSLATE_NOOP("qmeta::Iptc", "Keywords")},
+  {Iptc::kContentLocationCode,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Content Location Code")},
+  {Iptc::kContentLocationName,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Content Location Name")},
+  {Iptc::kReleaseDate, QT_TRANSLATE_NOOP("qmeta::Iptc", "Release Date")},
+  {Iptc::kReleaseTime, QT_TRANSLATE_NOOP("qmeta::Iptc", "Release Time")},
+  {Iptc::kExpirationDate, QT_TRANSLATE_NOOP("qmeta::Iptc", "Expiration Date")},
+  {Iptc::kExpirationTime, QT_TRANSLATE_NOOP("qmeta::Iptc", "Expiration Time")},
+  {Iptc::kSpecialInstructions,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Special Instructions")},
+  {Iptc::kActionAdvised, QT_TRANSLATE_NOOP("qmeta::Iptc", "Action Advised")},
+  {Iptc::kReferenceService,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Reference Service")},
+  {Iptc::kReferenceDate, QT_TRANSLATE_NOOP("qmeta::Iptc", "Reference Date")},
+  {Iptc::kReferenceNumber,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Reference Number")},
+  {Iptc::kDateCreated, QT_TRANSLATE_NOOP("qmeta::Iptc", "Date Created")},
+  {Iptc::kTimeCreated, QT_TRANSLATE_NOOP("qmeta::Iptc", "Time Created")},
+  {Iptc::kDigitalCreationDate,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Digital Creation Date")},
+  {Iptc::kDigitalCreationTime,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Digital Creation Time")},
+  {Iptc::kOriginatingProgram,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Originating Program")},
+  {Iptc::kProgramVersion, QT_TRANSLATE_NOOP("qmeta::Iptc", "Program Version")},
+  {Iptc::kObjectCycle, QT_TRANSLATE_NOOP("qmeta::Iptc", "Object Cycle")},
+  {Iptc::kByLine, QT_TRANSLATE_NOOP("qmeta::Iptc", "By Line")},
+  {Iptc::kByLineTitle, QT_TRANSLATE_NOOP("qmeta::Iptc", "By Line Title")},
+  {Iptc::kCity, QT_TRANSLATE_NOOP("qmeta::Iptc", "City")},
+  {Iptc::kSubLocation, QT_TRANSLATE_NOOP("qmeta::Iptc", "Sub Location")},
+  {Iptc::kProvinceState, QT_TRANSLATE_NOOP("qmeta::Iptc", "Province State")},
+  {Iptc::kCountryPrimaryLocationCode,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Country Primary Location Code")},
+  {Iptc::kCountryPrimaryLocationName,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Country Primary Location Name")},
+  {Iptc::kOriginalTransmissionReference,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Original Transmission Reference")},
+  {Iptc::kHeadline, QT_TRANSLATE_NOOP("qmeta::Iptc", "Headline")},
+  {Iptc::kCredit, QT_TRANSLATE_NOOP("qmeta::Iptc", "Credit")},
+  {Iptc::kSource, QT_TRANSLATE_NOOP("qmeta::Iptc", "Source")},
+  {Iptc::kCopyrightNotice,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Copyright Notice")},
+  {Iptc::kContact, QT_TRANSLATE_NOOP("qmeta::Iptc", "Contact")},
+  {Iptc::kCaptionAbstract,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Caption Abstract")},
+  {Iptc::kWriterEditor, QT_TRANSLATE_NOOP("qmeta::Iptc", "Writer Editor")},
+  {Iptc::kRasterizedCaption,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Rasterized Caption")},
+  {Iptc::kImageType, QT_TRANSLATE_NOOP("qmeta::Iptc", "Image Type")},
+  {Iptc::kImageOrientation,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Image Orientation")},
+  {Iptc::kLanguageIdentifier,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Language Identifier")},
+  {Iptc::kAudioType, QT_TRANSLATE_NOOP("qmeta::Iptc", "Audio Type")},
+  {Iptc::kAudioSamplingRate,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Audio Sampling Rate")},
+  {Iptc::kAudioSamplingResolution,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Audio Sampling Resolution")},
+  {Iptc::kAudioDuration, QT_TRANSLATE_NOOP("qmeta::Iptc", "Audio Duration")},
+  {Iptc::kAudioOutcue, QT_TRANSLATE_NOOP("qmeta::Iptc", "Audio Outcue")},
+  {Iptc::kObjDataPreviewFileFormat,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Object Data Preview File Format")},
+  {Iptc::kObjDataPreviewFileFormatVer,
+   QT_TRANSLATE_NOOP("qmeta::Iptc",
+                     "Object Data Preview File Format Version")},
+  {Iptc::kObjDataPreviewData,
+   QT_TRANSLATE_NOOP("qmeta::Iptc", "Object Data Preview Data")},
+};
+
+// Returns the metadata of the specified tag, or NULL if the tag is not used
+// in IPTC.
+const TagInfo* FindTagInfo(int tag) {
+  int low = 0;
+  int high = sizeof(kTagInfos) / sizeof(kTagInfos[0]) - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    if (kTagInfos[middle].tag < tag)
+      low = middle + 1;
+    else if (kTagInfos[middle].tag > tag)
+      high = middle - 1;
+    else
+      return &kTagInfos[middle];
+  }
+  return NULL;
 }
 
-// Initializes the IPTC object. Returns false if no valid tag is found.
-bool Iptc::Init(QIODevice *file, const qint64 file_start_offset) {
+}  // namespace
+
+Iptc::Iptc(QObject *parent) : Standard(parent) {}
+
+// Initializes the IPTC object with the IPTC data of the specified size
+// starting at the specified offset. The IPTC data is copied once if the
+// file is directly addressable. Returns false if no DataSet is found.
+bool Iptc::Init(QIODevice *file, const qint64 file_start_offset,
+                const qint64 size) {
   set_file(file);
   set_file_start_offset(file_start_offset);
-  return ReadRecord();
+  data_ = OwnedBytes(file, ReadBytesAt(file, file_start_offset, size));
+  return IndexDataSets();
 }
 
-// Adds all repeatable tags to the repeatable_tags_ property.
-void Iptc::InitRepeatableTags() {
-  QList<Tag> repeatable_tags;
-  repeatable_tags.append(kObjectAttributeReference);
-  repeatable_tags.append(kSubjectReference);
-  repeatable_tags.append(kSupplementalCategory);
-  repeatable_tags.append(kKeywords);
-  repeatable_tags.append(kContentLocationCode);
-  repeatable_tags.append(kContentLocationName);
-  repeatable_tags.append(kReferenceService);
-  repeatable_tags.append(kReferenceDate);
-  repeatable_tags.append(kReferenceNumber);
-  repeatable_tags.append(kByLine);
-  repeatable_tags.append(kByLineTitle);
-  repeatable_tags.append(kContact);
-  repeatable_tags.append(kWriterEditor);
-  set_repeatable_tags(repeatable_tags);
-}
-
-// Initializes tag names used in IPTC.
-void Iptc::InitTagNames() {
+// Returns the human-readable names of all tags used in IPTC. The names are
+// translated on each call, so prefer TagName() for individual tags.
+QHash<Iptc::Tag, QString> Iptc::tag_names() const {
   QHash<Tag, QString> tag_names;
-  tag_names.insert(kRecordVersion, tr("Record Version"));
-  tag_names.insert(kObjectTypeReference, tr("Object Type Reference"));
-  tag_names.insert(kObjectAttributeReference, tr("Object Attribute Reference"));
-  tag_names.insert(kObjectName, tr("Object Name"));
-  tag_names.insert(kEditStatus, tr("Edit Status"));
-  tag_names.insert(kEditorialUpdate, tr("Editorial Update"));
-  tag_names.insert(kUrgency, tr("Urgency"));
-  tag_names.insert(kSubjectReference, tr("Subject Reference"));
-  tag_names.insert(kCategory, tr("Category"));
-  tag_names.insert(kSupplementalCategory, tr("Supplemental Category"));
-  tag_names.insert(kFixtureIdentifier, tr("Fixture Identifier"));
-  tag_names.insert(kKeywords, tr("Keywords"));
-  tag_names.insert(kContentLocationCode, tr("Content Location Code"));
-  tag_names.insert(kContentLocationName, tr("Content Location Name"));
-  tag_names.insert(kReleaseDate, tr("Release Date"));
-  tag_names.insert(kReleaseTime, tr("Release Time"));
-  tag_names.insert(kExpirationDate, tr("Expiration Date"));
-  tag_names.insert(kExpirationTime, tr("Expiration Time"));
-  tag_names.insert(kSpecialInstructions, tr("Special Instructions"));
-  tag_names.insert(kActionAdvised, tr("Action Advised"));
-  tag_names.insert(kReferenceService, tr("Reference Service"));
-  tag_names.insert(kReferenceDate, tr("Reference Date"));
-  tag_names.insert(kReferenceNumber, tr("Reference Number"));
-  tag_names.insert(kDateCreated, tr("Date Created"));
-  tag_names.insert(kTimeCreated, tr("Time Created"));
-  tag_names.insert(kDigitalCreationDate, tr("Digital Creation Date"));
-  tag_names.insert(kDigitalCreationTime, tr("Digital Creation Time"));
-  tag_names.insert(kOriginatingProgram, tr("Originating Program"));
-  tag_names.insert(kProgramVersion, tr("Program Version"));
-  tag_names.insert(kObjectCycle, tr("Object Cycle"));
-  tag_names.insert(kByLine, tr("By Line"));
-  tag_names.insert(kByLineTitle, tr("By Line Title"));
-  tag_names.insert(kCity, tr("City"));
-  tag_names.insert(kSubLocation, tr("Sub Location"));
-  tag_names.insert(kProvinceState, tr("Province State"));
-  tag_names.insert(kCountryPrimaryLocationCode,
-                   tr("Country Primary Location Code"));
-  tag_names.insert(kCountryPrimaryLocationName,
-                   tr("Country Primary Location Name"));
-  tag_names.insert(kOriginalTransmissionReference,
-                   tr("Original Transmission Reference"));
-  tag_names.insert(kHeadline, tr("Headline"));
-  tag_names.insert(kCredit, tr("Credit"));
-  tag_names.insert(kSource, tr("Source"));
-  tag_names.insert(kCopyrightNotice, tr("Copyright Notice"));
-  tag_names.insert(kContact, tr("Contact"));
-  tag_names.insert(kCaptionAbstract, tr("Caption Abstract"));
-  tag_names.insert(kWriterEditor, tr("Writer Editor"));
-  tag_names.insert(kRasterizedCaption, tr("Rasterized Caption"));
-  tag_names.insert(kImageType, tr("Image Type"));
-  tag_names.insert(kImageOrientation, tr("Image Orientation"));
-  tag_names.insert(kLanguageIdentifier, tr("Language Identifier"));
-  tag_names.insert(kAudioType, tr("Audio Type"));
-  tag_names.insert(kAudioSamplingRate, tr("Audio Sampling Rate"));
-  tag_names.insert(kAudioSamplingResolution, tr("Audio Sampling Resolution"));
-  tag_names.insert(kAudioDuration, tr("Audio Duration"));
-  tag_names.insert(kAudioOutcue, tr("Audio Outcue"));
-  tag_names.insert(kObjDataPreviewFileFormat,
-                   tr("Object Data Preview File Format"));
-  tag_names.insert(kObjDataPreviewFileFormatVer,
-                   tr("Object Data Preview File Format Version"));
-  tag_names.insert(kObjDataPreviewData, tr("Object Data Preview Data"));
-  set_tag_names(tag_names);
+  int count = sizeof(kTagInfos) / sizeof(kTagInfos[0]);
+  tag_names.reserve(count);
+  for (int i = 0; i < count; ++i)
+    tag_names.insert(static_cast<Tag>(kTagInfos[i].tag), tr(kTagInfos[i].name));
+  return tag_names;
 }
 
-// Reads the DataSet started from the specified offset.
-QByteArray Iptc::ReadDataSet(int offset) {
-  QByteArray data;
-  file()->seek(offset);
-  Tag tag = static_cast<Tag>(file()->read(1).toHex().toInt(NULL, 16));
-  if (!tag_names().contains(tag))
-    return data;
-  int size = file()->read(2).toHex().toInt(NULL, 16);
-  data = file()->read(size);
-  return data;
+// Returns the translated human-readable name of the specified tag. Returns
+// an empty string if the tag is not used in IPTC.
+QString Iptc::TagName(Tag tag) {
+  const TagInfo *tag_info = FindTagInfo(tag);
+  if (!tag_info)
+    return QString();
+  return tr(tag_info->name);
 }
 
-// Reads the Record started from the specified offset. Also saves all found
-// tags and their offsets in the tag_offsets_ property. Returns false if
-// no tag is found.
-bool Iptc::ReadRecord() {
-  file()->seek(file_start_offset());
-  QHash<Tag, qint64> tag_offsets;
-  while (file()->read(2).toHex() == "1c02") {
-    qint64 tag_offset = file()->pos();
-    Tag tag = static_cast<Tag>(file()->read(1).toHex().toInt(NULL, 16));
-    QByteArray data = ReadDataSet(tag_offset);
-
-    if (repeatable_tags().contains(tag))
-      tag_offsets.insertMulti(tag, tag_offset);
-    else
-      tag_offsets.insert(tag, tag_offset);
+// Indexes the spans of all DataSets in data_ in a single pass. Each DataSet
+// starts with the tag marker 0x1c, the record number, the DataSet number,
+// and a 2-byte size. If the high bit of the size is set, the other bits are
+// the number of following bytes holding the actual size. Indexing stops at
+// the first invalid DataSet. Returns false if no DataSet is found.
+bool Iptc::IndexDataSets() {
+  QVector<DataSet> data_sets;
+  const char *data = data_.constData();
+  int pos = 0;
+  while (pos + 5 <= data_.size() && data[pos] == 0x1c) {
+    DataSet data_set;
+    data_set.record = static_cast<quint8>(data[pos + 1]);
+    data_set.number = static_cast<quint8>(data[pos + 2]);
+    quint16 size_field = DecodeUInt16<kBigEndians>(data + pos + 3);
+    pos += 5;
+    qint64 size = size_field;
+    if (size_field & 0x8000) {
+      // Extended DataSet.
+      int size_length = size_field & 0x7fff;
+      if (size_length == 0 || size_length > 4 ||
+          pos + size_length > data_.size())
+        break;
+      size = 0;
+      for (int i = 0; i < size_length; ++i)
+        size = (size << 8) | static_cast<quint8>(data[pos + i]);
+      pos += size_length;
+    }
+    if (size > data_.size() - pos)
+      break;
+    data_set.offset = pos;
+    data_set.size = static_cast<int>(size);
+    data_sets.append(data_set);
+    pos += data_set.size;
   }
-  // Returns false if no valid tag is found.
-  if (tag_offsets.count() == 0)
-    return false;
-
-  set_tag_offsets(tag_offsets);
-  return true;
+  data_sets.squeeze();
+  set_data_sets(data_sets);
+  return !data_sets.isEmpty();
 }
 
-// Returns the value associated with the specified tag.
+// Returns the value associated with the specified tag of the application
+// record.
 QByteArray Iptc::Value(Tag tag) {
-  QByteArray value;
-  if (tag_offsets().contains(tag)) {
-    int offset = tag_offsets().value(tag);
-    value = ReadDataSet(offset);
+  return Value(kApplicationRecord, tag);
+}
+
+// Returns the value of the DataSet with the specified record and DataSet
+// numbers. If the DataSet appears more than once, returns the last one.
+// The value is taken from the indexed data without any I/O.
+QByteArray Iptc::Value(int record, int number) {
+  for (int i = data_sets_.count() - 1; i >= 0; --i) {
+    const DataSet &data_set = data_sets_.at(i);
+    if (data_set.record == record && data_set.number == number)
+      return data_.mid(data_set.offset, data_set.size);
   }
-  return value;
+  return QByteArray();
 }
 
-// Returns a lit containing all the values associated with the specified tag.
+// Returns a list containing all the values associated with the specified
+// tag of the application record.
 QList<QByteArray> Iptc::Values(Tag tag) {
+  return Values(kApplicationRecord, tag);
+}
+
+// Returns a sorted list containing the values of all DataSets with the
+// specified record and DataSet numbers. The values are taken from the
+// indexed data without any I/O.
+QList<QByteArray> Iptc::Values(int record, int number) {
   QList<QByteArray> values;
-  QList<qint64> offsets = tag_offsets().values(tag);
-  for (int i = 0; i < offsets.count(); ++i) {
-    qint64 offset = offsets.at(i);
-    QByteArray value = ReadDataSet(offset);
-    values.append(value);
+  for (int i = 0; i < data_sets_.count(); ++i) {
+    const DataSet &data_set = data_sets_.at(i);
+    if (data_set.record == record && data_set.number == number)
+      values.append(data_.mid(data_set.offset, data_set.size));
   }
   qSort(values);
   return values;
@@ -25,24 +25,35 @@
 #include "qmeta/jpeg.h"
 
 #include <QtCore>
-#include <qitty/byte_array.h>
 
 #include "qmeta/exif.h"
+#include "qmeta/io.h"
 #include "qmeta/iptc.h"
 #include "qmeta/tiff_header.h"
 #include "qmeta/xmp.h"
 
 namespace qmeta {
 
-Jpeg::Jpeg(QByteArray *data) : File(data) {
-  InitMetadata();
+Jpeg::Jpeg(QByteArray *data, Options options) : File(data, options) {
+  Init();
 }
 
-Jpeg::Jpeg(QIODevice *file) : File(file) {
-  InitMetadata();
+Jpeg::Jpeg(QIODevice *file, Options options) : File(file, options) {
+  Init();
+}
+
+Jpeg::Jpeg(const QString &file_name, Options options)
+    : File(file_name, options) {
+  Init();
 }
 
-Jpeg::Jpeg(const QString &file_name) : File(file_name) {
+// Initializes the Jpeg object.
+void Jpeg::Init() {
+  if (!file())
+    return;
+
+  PrefetchHeader();
+  InitSegments();
   InitMetadata();
 }
 
@@ -51,9 +62,9 @@ bool Jpeg::IsValid() {
   if (!file())
     return false;
 
-  // Checks the first 2 bytes if equals to the SOI marker.
-  file()->seek(0);
-  if (file()->read(2).toHex() != "ffd8")
+  // The segment index always starts with the SOI marker if the tracked file
+  // is a JPEG file.
+  if (segments().isEmpty())
     return false;
 
   return true;
@@ -61,29 +72,29 @@ bool Jpeg::IsValid() {
 
 // Reimplements the File::InitExif().
 void Jpeg::InitExif() {
-  file()->seek(2);
-  while (!file()->atEnd()) {
-    // Finds APP1 marker.
-    if (file()->read(1).toHex() != "ff")
-      continue;
-    if (file()->read(1).toHex() != "e1")
+  // Finds the APP1 segment containing the Exif signature.
+  qint64 tiff_header_offset = -1;
+  for (int i = 0; i < segments().count(); ++i) {
+    const Segment &segment = segments().at(i);
+    if (segment.marker != kAPP1Marker)
       continue;
 
-    // Retrieves the APP1 length. The length doesn't include the APP1 marker.
-    file()->read(2).toHex().toInt(NULL, 16);
-
-    // Checks the Exif signature.
-    if (QString(file()->read(6)) == "Exif")
+    // Checks the Exif signature, which is followed by a pad byte.
+    file()->seek(segment.offset + 4);
+    if (ReadBytes(file(), 6) == QByteArray("Exif\0\0", 6)) {
+      tiff_header_offset = file()->pos();
       break;
+    }
   }
-  if (file()->atEnd())
+  if (tiff_header_offset == -1)
     return;
 
   TiffHeader *tiff_header = new TiffHeader(this);
-  if (tiff_header->Init(file(), file()->pos())) {
+  if (tiff_header->Init(file(), tiff_header_offset)) {
     // Creates the Exif object.
     Exif *exif = new Exif(this);
-    if (exif->Init(file(), tiff_header))
+    if (exif->Init(file(), tiff_header,
+                   !(options() & kExifOption)))
       set_exif(exif);
     else
       delete exif;
@@ -94,88 +105,179 @@ void Jpeg::InitExif() {
 
 // Reimplements the File::InitIptc().
 void Jpeg::InitIptc() {
-  // Finds the APP13 marker.
-  file()->seek(2);
-  while (!file()->atEnd()) {
-    if (file()->read(1).toHex() != "ff")
+  for (int i = 0; i < segments().count(); ++i) {
+    const Segment &segment = segments().at(i);
+    if (segment.marker != kAPP13Marker)
       continue;
-    if (file()->read(1).toHex() != "ed")
+
+    // Checks the Photoshop signature.
+    file()->seek(segment.offset + 4);
+    if (ReadBytes(file(), 14) != QByteArray("Photoshop 3.0\0", 14))
       continue;
-    break;
-  }
-  // Returns if there is not APP13 marker.
-  if (file()->atEnd())
-    return;
 
-  // Skips segment size marker.
-  file()->read(2);
+    // The offset right after the APP13 segment.
+    qint64 segment_end = segment.offset + 2 + segment.length;
+    bool found_iptc = false;
+    qint64 iptc_length = 0;
+    // Interators the Image Resource Blocks to find IPTC data. If found, sets
+    // the `found_iptc` to true and gets out of the loop.
+    while (file()->pos() < segment_end &&
+           ReadBytes(file(), 4) == QByteArray("8BIM")) {
+      int identifier = ReadUInt16<kBigEndians>(file());
+      // Skips the variable name in Pascal string, padded to make the size
+      // even. A null name consists of two bytes of 0.
+      int name_length = ReadUInt8(file());
+      if (name_length == 0)
+        ReadBytes(file(), 1);
+      else if (name_length % 2 == 1)
+        ReadBytes(file(), name_length);
+      else
+        ReadBytes(file(), name_length + 1);
+      // Determines the actual size of resource data that follows.
+      qint64 data_length = ReadUInt32<kBigEndians>(file());
+      // Determines if the current block is used to record the IPTC data.
+      // If true, the identifier should be 1028 in decimal.
+      if (identifier == 1028) {
+        found_iptc = true;
+        iptc_length = data_length;
+        break;
+      } else {
+        // Resource data is padded to make the size even.
+        file()->seek(file()->pos() + data_length + data_length % 2);
+      }
+    }
+    // Checks the next APP13 segment if there is no IPTC data.
+    if (!found_iptc)
+      continue;
 
-  // Checks the Photoshop signature.
-  if (QString(file()->read(14)) != "Photoshop 3.0")
+    // Creates the Iptc object. The IPTC data cannot exceed the segment.
+    Iptc *iptc = new Iptc(this);
+    if (iptc->Init(file(), file()->pos(),
+                   qMin(iptc_length, segment_end - file()->pos())))
+      set_iptc(iptc);
+    else
+      delete iptc;
     return;
+  }
+}
 
-  bool found_iptc = false;
-  // Interators the Image Resource Blocks to find IPTC data. If found, sets the
-  // `found_iptc` to true and gets out of the loop.
-  while (QString(file()->read(4)) == "8BIM") {
-    int identifier = file()->read(2).toHex().toInt(NULL, 16);
-    // Skips the variable name in Pascal string, padded to make the size even.
-    // A null name consists of two bytes of 0.
-    int name_length = file()->read(1).toHex().toInt(NULL, 16);
-    if (name_length == 0)
-      file()->read(1);
-    else if (name_length % 2 == 1)
-      file()->read(name_length);
-    else
-      file()->read(name_length + 1);
-    // Determines the actual size of resource data that follows.
-    int data_length = file()->read(4).toHex().toInt(NULL, 16);
-    // Determines if the current block is used to record the IPTC data.
-    // If true, the identifier should be 1028 in decimal.
-    if (identifier == 1028) {
-      found_iptc = true;
-      break;
-    } else {
-      file()->read(data_length);
+// Returns the offset of the first marker at or after the specified offset in
+// entropy-coded image data, skipping stuffed zero bytes, fill bytes and
+// restart markers. The data is scanned in blocks. Returns -1 if there is no
+// such marker.
+qint64 Jpeg::FindMarker(qint64 offset) {
+  const qint64 kBlockSize = 64 * 1024;
+  while (true) {
+    // Reads one more byte so the code following a 0xFF byte at the end of
+    // the block is known.
+    QByteArray block = ReadBytesAt(file(), offset, kBlockSize + 1);
+    if (block.size() < 2)
+      return -1;
+    const char *begin = block.constData();
+    const char *end = begin + block.size() - 1;
+    const char *byte = begin;
+    while ((byte = static_cast<const char*>(memchr(byte, 0xff, end - byte)))) {
+      int code = static_cast<uchar>(byte[1]);
+      if (code != 0x00 && code != 0xff &&
+          (code < kRST0Marker || code > kRST7Marker))
+        return offset + (byte - begin);
+      ++byte;
     }
+    offset += block.size() - 1;
   }
-  // Returns if there is no IPTC data.
-  if (!found_iptc)
+}
+
+// Builds the index of marker segments by following the segment length fields
+// from the SOI marker. By default stops at the SOS marker since the
+// entropy-coded image data follows, so only the header region is read. If
+// kTrailingSegmentsOption is specified, the image data is scanned for the
+// following markers and the index continues until the data following the EOI
+// marker no longer starts with a marker. If the tracked file doesn't start
+// with the SOI marker, the index is left empty.
+void Jpeg::InitSegments() {
+  QList<Segment> segments;
+  file()->seek(0);
+  QByteArray soi = ReadBytes(file(), 2);
+  if (soi.size() != 2 || static_cast<uchar>(soi.at(0)) != 0xff ||
+      static_cast<uchar>(soi.at(1)) != kSOIMarker) {
+    set_segments(segments);
     return;
+  }
+  Segment soi_segment = {kSOIMarker, 0, 0};
+  segments.append(soi_segment);
+
+  qint64 offset = 2;
+  while (file()->seek(offset)) {
+    // Reads the marker and the possible length field at once.
+    QByteArray header = ReadBytes(file(), 4);
+    if (header.size() < 2 || static_cast<uchar>(header.at(0)) != 0xff)
+      break;
+    int marker = static_cast<uchar>(header.at(1));
+    // Any marker may be preceded by fill bytes of 0xFF.
+    if (marker == 0xff) {
+      ++offset;
+      continue;
+    }
 
-  // Creates the Iptc object.
-  Iptc *iptc = new Iptc(this);
-  if (iptc->Init(file(), file()->pos()))
-    set_iptc(iptc);
-  else
-    delete iptc;
+    Segment segment = {marker, offset, 0};
+    // Standalone markers have no length field.
+    if (marker == kTEMMarker ||
+        (marker >= kRST0Marker && marker <= kRST7Marker)) {
+      segments.append(segment);
+      offset += 2;
+      continue;
+    }
+    if (marker == kEOIMarker) {
+      segments.append(segment);
+      if (!(options() & kTrailingSegmentsOption))
+        break;
+      offset += 2;
+      continue;
+    }
+    // The length field includes itself, so must be at least 2.
+    if (header.size() < 4)
+      break;
+    int length = (static_cast<uchar>(header.at(2)) << 8) |
+                 static_cast<uchar>(header.at(3));
+    if (length < 2)
+      break;
+    segment.length = length;
+    segments.append(segment);
+    offset += 2 + length;
+    if (marker == kSOSMarker) {
+      if (!(options() & kTrailingSegmentsOption))
+        break;
+      offset = FindMarker(offset);
+      if (offset == -1)
+        break;
+    }
+  }
+  set_segments(segments);
 }
 
 // Reimplements the File::InitXmp().
 void Jpeg::InitXmp() {
-  file()->seek(2);
-  while (!file()->atEnd()) {
-    // Finds APP1 marker.
-    if (file()->read(1).toHex() != "ff")
-      continue;
-    if (file()->read(1).toHex() != "e1")
+  // The XMP signature in APP1 segments, including the trailing null byte.
+  const QByteArray kXmpSignature("http://ns.adobe.com/xap/1.0/", 29);
+  for (int i = 0; i < segments().count(); ++i) {
+    const Segment &segment = segments().at(i);
+    if (segment.marker != kAPP1Marker)
       continue;
 
-    // Retrieves the APP1 length. The length doesn't include the APP1 marker.
-    file()->read(2).toHex().toInt(NULL, 16);
-
     // Checks the XMP signature.
-    if (QString(file()->read(29)) == "http://ns.adobe.com/xap/1.0/")
-      break;
-  }
-  if (file()->atEnd())
-    return;
+    file()->seek(segment.offset + 4);
+    if (ReadBytes(file(), kXmpSignature.size()) != kXmpSignature)
+      continue;
 
-  Xmp *xmp = new Xmp(this);
-  if (xmp->Init(file(), file()->pos()))
-    set_xmp(xmp);
-  else
-    delete xmp;
+    // The packet occupies the rest of the segment.
+    Xmp *xmp = new Xmp(this);
+    if (xmp->Init(file(), file()->pos(),
+                  segment.length - 2 - kXmpSignature.size()))
+      set_xmp(xmp);
+    else
+      delete xmp;
+    return;
+  }
 }
 
 }  // namespace qmeta
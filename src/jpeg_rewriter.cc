@@ -0,0 +1,405 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the detail of the JpegRewriter class.
+
+#include "qmeta/jpeg_rewriter.h"
+
+#include <cstdio>
+
+#include <QtCore>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+#include "qmeta/byte_order.h"
+#include "qmeta/io.h"
+
+namespace qmeta {
+
+namespace {
+
+// The signature preceding the TIFF header in Exif APP1 segments.
+const char kExifSignature[] = "Exif\0\0";
+const int kExifSignatureSize = 6;
+// The signature of Photoshop APP13 segments.
+const char kPhotoshopSignature[] = "Photoshop 3.0\0";
+const int kPhotoshopSignatureSize = 14;
+// The signature of XMP APP1 segments, including the trailing null byte.
+const char kXmpSignature[] = "http://ns.adobe.com/xap/1.0/\0";
+const int kXmpSignatureSize = 29;
+// The signature of the APP1 segments of Adobe extended XMP, which carry the
+// chunks of the extended packet referred to by the main XMP packet.
+const char kExtendedXmpSignature[] = "http://ns.adobe.com/xmp/extension/\0";
+const int kExtendedXmpSignatureSize = 35;
+// The identifier of the Image Resource Block containing IPTC data.
+const int kIptcResourceId = 1028;
+// The largest payload of a marker segment, excluding the length field.
+const int kMaxPayloadSize = 65533;
+
+// Returns the number of bytes the specified segment occupies in the file,
+// including the marker.
+qint64 SegmentSize(const Jpeg::Segment &segment) {
+  return segment.length ? 2 + segment.length : 2;
+}
+
+// Removes the IPTC block from the specified Image Resource Blocks of a
+// Photoshop APP13 payload excluding the signature. Returns the remaining
+// blocks. Bytes from the first block that cannot be parsed, such as
+// padding or a malformed block, are kept unchanged so no other resource is
+// lost.
+QByteArray RemoveIptcResource(const QByteArray &resources) {
+  QByteArray result;
+  int pos = 0;
+  while (pos + 4 <= resources.size() &&
+         resources.mid(pos, 4) == QByteArray("8BIM")) {
+    // The identifier and the Pascal name padded to make the size even.
+    if (pos + 7 > resources.size())
+      break;
+    int identifier = DecodeUInt16<kBigEndians>(resources.constData() + pos +
+                                               4);
+    int name_length = static_cast<quint8>(resources.at(pos + 6));
+    int data_length_pos = pos + 6 + name_length + 1 + (name_length + 1) % 2;
+    if (data_length_pos + 4 > resources.size())
+      break;
+    qint64 data_length = DecodeUInt32<kBigEndians>(resources.constData() +
+                                                   data_length_pos);
+    qint64 end = data_length_pos + 4 + data_length + data_length % 2;
+    if (end > resources.size())
+      break;
+    if (identifier != kIptcResourceId)
+      result.append(resources.mid(pos, static_cast<int>(end - pos)));
+    pos = static_cast<int>(end);
+  }
+  result.append(resources.mid(pos));
+  return result;
+}
+
+}  // namespace
+
+// Constructs a rewriter for the file tracked by the specified Jpeg object.
+// The Jpeg object must outlive the rewriter.
+JpegRewriter::JpegRewriter(Jpeg *jpeg) : jpeg_(jpeg), owned_jpeg_(NULL) {
+}
+
+// Constructs a rewriter for the specified JPEG file. Only the segment index
+// of the file is built, no metadata is parsed.
+JpegRewriter::JpegRewriter(const QString &file_name)
+    : owned_jpeg_(new Jpeg(file_name, File::Options())) {
+  jpeg_ = owned_jpeg_;
+}
+
+JpegRewriter::~JpegRewriter() {
+  delete owned_jpeg_;
+}
+
+// Appends literal bytes to the specified blocks, merging them with the last
+// block if it also consists of literal bytes.
+void JpegRewriter::AppendLiteral(const QByteArray &data,
+                                 QList<Block> *blocks) {
+  if (data.isEmpty())
+    return;
+  if (!blocks->isEmpty() && blocks->last().offset < 0) {
+    blocks->last().data.append(data);
+    blocks->last().size += data.size();
+    return;
+  }
+  Block block;
+  block.offset = -1;
+  block.size = data.size();
+  block.data = data;
+  blocks->append(block);
+}
+
+// Appends a range of the source file to the specified blocks, merging it
+// with the last block if the last block is the preceding range. Merging
+// keeps the untouched parts of the file in as few copies as possible.
+void JpegRewriter::AppendRange(qint64 offset, qint64 size,
+                               QList<Block> *blocks) {
+  if (size <= 0)
+    return;
+  if (!blocks->isEmpty() && blocks->last().offset >= 0 &&
+      blocks->last().offset + blocks->last().size == offset) {
+    blocks->last().size += size;
+    return;
+  }
+  Block block;
+  block.offset = offset;
+  block.size = size;
+  blocks->append(block);
+}
+
+// Returns the kind of the specified segment by checking its marker and
+// signature. Extended XMP segments are of the XMP kind, so they are removed
+// along with the main XMP segment, whose replacement would no longer refer
+// to them.
+JpegRewriter::Kind JpegRewriter::Classify(const Jpeg::Segment &segment) const {
+  if (segment.marker != Jpeg::kAPP1Marker &&
+      segment.marker != Jpeg::kAPP13Marker)
+    return kOtherKind;
+
+  QByteArray signature = ReadBytesAt(jpeg_->file(), segment.offset + 4,
+                                     qMin(kExtendedXmpSignatureSize,
+                                          segment.length - 2));
+  if (segment.marker == Jpeg::kAPP13Marker) {
+    if (signature.startsWith(QByteArray(kPhotoshopSignature,
+                                        kPhotoshopSignatureSize)))
+      return kIptcKind;
+  } else if (signature.startsWith(QByteArray(kExifSignature,
+                                             kExifSignatureSize))) {
+    return kExifKind;
+  } else if (signature.startsWith(QByteArray(kXmpSignature,
+                                             kXmpSignatureSize)) ||
+             signature == QByteArray(kExtendedXmpSignature,
+                                     kExtendedXmpSignatureSize)) {
+    return kXmpKind;
+  }
+  return kOtherKind;
+}
+
+// Returns true if the rewriter can rewrite the file.
+bool JpegRewriter::IsValid() const {
+  return jpeg_ && jpeg_->IsValid() &&
+         jpeg_->segments().first().marker == Jpeg::kSOIMarker;
+}
+
+// Creates the segment of the specified kind with the specified data and
+// sets it to bytes. If segment is not NULL, it is the existing segment
+// being replaced, otherwise the segment is inserted. Sets bytes to empty if
+// the segment should be removed. Returns false if the new segment exceeds
+// the maximum segment size.
+bool JpegRewriter::MakeSegment(Kind kind, const QByteArray &data,
+                               const Jpeg::Segment *segment,
+                               QByteArray *bytes) const {
+  bytes->clear();
+  QByteArray payload;
+  int marker = Jpeg::kAPP1Marker;
+  if (kind == kExifKind) {
+    if (!data.isEmpty())
+      payload = QByteArray(kExifSignature, kExifSignatureSize) + data;
+  } else if (kind == kXmpKind) {
+    if (!data.isEmpty())
+      payload = QByteArray(kXmpSignature, kXmpSignatureSize) + data;
+  } else if (kind == kIptcKind) {
+    // Keeps the other Image Resource Blocks of the existing segment.
+    marker = Jpeg::kAPP13Marker;
+    QByteArray resources;
+    if (segment) {
+      resources = RemoveIptcResource(
+          ReadBytesAt(jpeg_->file(),
+                      segment->offset + 4 + kPhotoshopSignatureSize,
+                      segment->length - 2 - kPhotoshopSignatureSize));
+    }
+    if (!data.isEmpty()) {
+      char header[12] = {'8', 'B', 'I', 'M', 0, 0, 0, 0};
+      EncodeUInt16(kIptcResourceId, kBigEndians, header + 4);
+      EncodeUInt32(data.size(), kBigEndians, header + 8);
+      resources.append(QByteArray(header, 12));
+      resources.append(data);
+      if (data.size() % 2 == 1)
+        resources.append('\0');
+    }
+    if (!resources.isEmpty()) {
+      payload = QByteArray(kPhotoshopSignature, kPhotoshopSignatureSize) +
+                resources;
+    }
+  }
+  if (payload.isEmpty())
+    return true;
+  if (payload.size() > kMaxPayloadSize)
+    return false;
+
+  char header[4] = {'\xff', static_cast<char>(marker), 0, 0};
+  EncodeUInt16(payload.size() + 2, kBigEndians, header + 2);
+  *bytes = QByteArray(header, 4) + payload;
+  return true;
+}
+
+// Plans the output as blocks of literal bytes and ranges of the source
+// file. New segments replace the first existing segment of the same kind
+// and other segments of the kind are removed, except that Photoshop APP13
+// segments keep their other Image Resource Blocks. New segments without an
+// existing one are inserted after the SOI marker and the JFIF APP0
+// segments. Everything from the SOS marker to the end of the file is copied
+// as a single range. Returns false if a new segment is too large.
+bool JpegRewriter::Plan(QList<Block> *blocks) const {
+  const QList<Jpeg::Segment> segments = jpeg_->segments();
+  // Determines the kind of each segment up to the image data.
+  QList<Kind> kinds;
+  qint64 tail_offset = -1;
+  for (int i = 0; i < segments.count(); ++i) {
+    const Jpeg::Segment &segment = segments.at(i);
+    if (i > 0 && (segment.marker == Jpeg::kSOSMarker ||
+                  segment.marker == Jpeg::kEOIMarker)) {
+      tail_offset = segment.offset;
+      break;
+    }
+    kinds.append(Classify(segment));
+  }
+  if (tail_offset < 0) {
+    const Jpeg::Segment &segment = segments.last();
+    tail_offset = segment.offset + SegmentSize(segment);
+  }
+
+  // Keeps the SOI marker and the JFIF APP0 segments.
+  int index = 1;
+  AppendRange(0, 2, blocks);
+  while (index < kinds.count() &&
+         segments.at(index).marker == Jpeg::kAPP0Marker) {
+    AppendRange(segments.at(index).offset, SegmentSize(segments.at(index)),
+                blocks);
+    ++index;
+  }
+
+  // Inserts the new segments that have no existing segment to replace.
+  const Kind kKinds[] = {kExifKind, kXmpKind, kIptcKind};
+  for (int i = 0; i < 3; ++i) {
+    if (!replacements_.contains(kKinds[i]) || kinds.contains(kKinds[i]))
+      continue;
+    QByteArray bytes;
+    if (!MakeSegment(kKinds[i], replacements_.value(kKinds[i]), NULL,
+                     &bytes))
+      return false;
+    AppendLiteral(bytes, blocks);
+  }
+
+  // Copies or replaces the remaining segments.
+  for (; index < kinds.count(); ++index) {
+    const Jpeg::Segment &segment = segments.at(index);
+    Kind kind = kinds.at(index);
+    if (kind == kOtherKind || !replacements_.contains(kind)) {
+      AppendRange(segment.offset, SegmentSize(segment), blocks);
+      continue;
+    }
+    // Only the first segment of the kind receives the new data.
+    bool is_first = kinds.indexOf(kind) == index;
+    if (!is_first && kind != kIptcKind)
+      continue;
+    QByteArray bytes;
+    if (!MakeSegment(kind, is_first ? replacements_.value(kind) : QByteArray(),
+                     &segment, &bytes))
+      return false;
+    AppendLiteral(bytes, blocks);
+  }
+
+  AppendRange(tail_offset, jpeg_->file()->size() - tail_offset, blocks);
+  return true;
+}
+
+// Removes the Exif segments from the rewritten file.
+void JpegRewriter::RemoveExif() {
+  replacements_.insert(kExifKind, QByteArray());
+}
+
+// Removes the IPTC data from the rewritten file. Other Image Resource
+// Blocks in Photoshop segments are kept.
+void JpegRewriter::RemoveIptc() {
+  replacements_.insert(kIptcKind, QByteArray());
+}
+
+// Removes the XMP segments, including extended XMP segments, from the
+// rewritten file.
+void JpegRewriter::RemoveXmp() {
+  replacements_.insert(kXmpKind, QByteArray());
+}
+
+// Sets the Exif data of the rewritten file to the specified TIFF structure
+// starting with the TIFF header. Offsets in the structure are relative to
+// the TIFF header, so it can be copied from any Exif segment or TIFF file.
+// An empty structure removes the Exif segments.
+void JpegRewriter::SetExif(const QByteArray &tiff_data) {
+  replacements_.insert(kExifKind, tiff_data);
+}
+
+// Sets the IPTC data of the rewritten file to the specified IIM datasets.
+// An empty data removes the IPTC data.
+void JpegRewriter::SetIptc(const QByteArray &iptc_data) {
+  replacements_.insert(kIptcKind, iptc_data);
+}
+
+// Sets the XMP packet of the rewritten file. Existing extended XMP
+// segments are removed. An empty packet removes the XMP segments.
+void JpegRewriter::SetXmp(const QByteArray &packet) {
+  replacements_.insert(kXmpKind, packet);
+}
+
+// Writes the rewritten file to the current position of the specified
+// output. Untouched parts of the source file are copied in large blocks.
+// Returns true on success.
+bool JpegRewriter::Write(QIODevice *output) {
+  if (!IsValid() || !output->isWritable())
+    return false;
+
+  QList<Block> blocks;
+  if (!Plan(&blocks))
+    return false;
+  for (int i = 0; i < blocks.count(); ++i) {
+    const Block &block = blocks.at(i);
+    qint64 written_size;
+    if (block.offset < 0)
+      written_size = output->write(block.data);
+    else
+      written_size = CopyBytes(jpeg_->file(), block.offset, block.size, output);
+    if (written_size != block.size)
+      return false;
+  }
+  return true;
+}
+
+// Writes the rewritten file to the specified file name, which may be the
+// source file itself. The content is written to a temporary file in the
+// same directory which then atomically replaces the specified file, so the
+// file is never left partially written. The permissions of an existing file
+// are kept. Returns true on success.
+bool JpegRewriter::Write(const QString &file_name) {
+  if (!IsValid())
+    return false;
+
+  QFileInfo file_info(file_name);
+  QTemporaryFile temporary_file(file_info.absoluteFilePath() + ".XXXXXX");
+  if (!temporary_file.open() || !Write(&temporary_file) ||
+      !temporary_file.flush())
+    return false;
+#ifdef Q_OS_UNIX
+  if (fsync(temporary_file.handle()) != 0)
+    return false;
+#endif
+  if (file_info.exists())
+    temporary_file.setPermissions(QFile::permissions(file_name));
+  temporary_file.close();
+
+#ifdef Q_OS_WIN
+  // Windows cannot rename over an existing file with QFile.
+  QFile::remove(file_name);
+  if (!temporary_file.rename(file_name))
+    return false;
+#else
+  if (std::rename(QFile::encodeName(temporary_file.fileName()).constData(),
+                  QFile::encodeName(file_name).constData()) != 0)
+    return false;
+#endif
+  temporary_file.setAutoRemove(false);
+  return true;
+}
+
+}  // namespace qmeta
@@ -0,0 +1,423 @@
+// Copyright 2010, Ollix
+// All rights reserved.
+//
+// This file is part of QMeta.
+//
+// QMeta is free software: you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free
+// Software Foundation, either version 3 of the License, or any later version.
+//
+// QMeta is distributed in the hope that it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with QMeta. If not, see <http://www.gnu.org/licenses/>.
+
+// ---
+// Author: olliwang@ollix.com (Olli Wang)
+//
+// QMeta - a library to manipulate image metadata based on Qt.
+//
+// This file implements the detail of the Raw class.
+
+#include "qmeta/raw.h"
+
+#include <QtCore>
+
+#include "qmeta/exif.h"
+#include "qmeta/exif_data.h"
+#include "qmeta/io.h"
+
+namespace qmeta {
+
+namespace {
+
+// The tags not defined in Exif that are used to identify raw formats and
+// to locate their previews, represented in decimal.
+const int kNewSubfileTypeTag = 254;
+const int kDngVersionTag = 50706;
+const int kCr2SliceTag = 50752;
+
+// The compression schemes of JPEG data in TIFF.
+const int kOldJpegCompression = 6;
+const int kJpegCompression = 7;
+
+// The photometric interpretations of raw sensor data.
+const int kCfaPhotometricInterpretation = 32803;
+const int kLinearRawPhotometricInterpretation = 34892;
+
+// The vendor compression schemes of raw sensor data.
+const int kRawCompressions[] = {
+  32767,  // Sony ARW
+  34713,  // Nikon NEF
+  65535,  // Pentax PEF
+};
+
+// Maps the make recorded in IFD0 of TIFF-based files to the raw format.
+// TIFF files with these makes are only of the raw format if they contain
+// raw sensor data, since cameras and scanners of the makers also write
+// ordinary TIFF files.
+struct RawMake {
+  // The leading characters of the make in upper case.
+  const char *make;
+  // The raw format of the files with the make.
+  FileType file_type;
+};
+
+const RawMake kRawMakes[] = {
+  {"NIKON", kNefFileType},
+  {"SONY", kArwFileType},
+  {"PENTAX", kPefFileType},
+  {"RICOH", kPefFileType},
+};
+
+// Describes a maker note format that records the location of an embedded
+// JPEG preview.
+struct MakerNoteFormat {
+  // The leading bytes of the maker note.
+  const char *magic;
+  // The number of bytes in magic.
+  int magic_size;
+  // The offset of the TIFF header in the maker note, or -1 if the maker note
+  // has no TIFF header. Offsets in a maker note with a TIFF header are
+  // relative to that header.
+  int tiff_header_offset;
+  // The offset of the IFD in the maker note if it has no TIFF header.
+  int ifd_offset;
+  // The offset of the byte order mark in the maker note, or -1 if there is
+  // none. Maker notes without a TIFF header are only read if they are in the
+  // byte order of the file.
+  int byte_order_offset;
+  // Whether offsets in the maker note without a TIFF header are relative to
+  // the maker note instead of the TIFF header of the file.
+  bool is_relative_to_maker_note;
+  // The tag of the entry pointing to the IFD with the preview tags, or 0 if
+  // the preview tags are in the IFD of the maker note.
+  int preview_ifd_tag;
+  // The tag of the preview offset.
+  int preview_offset_tag;
+  // The tag of the preview length.
+  int preview_length_tag;
+};
+
+const MakerNoteFormat kMakerNoteFormats[] = {
+  // Nikon type 3 maker notes with the NikonPreview IFD.
+  {"Nikon\0\x02", 7, 10, 0, -1, false, 0x0011, 0x0201, 0x0202},
+  // Olympus type 2 maker notes with the CameraSettings IFD.
+  {"OLYMPUS\0", 8, -1, 12, 8, true, 0x2020, 0x0101, 0x0102},
+  // Pentax maker notes.
+  {"AOC\0", 4, -1, 6, 4, false, 0, 0x0004, 0x0003},
+};
+
+// The number of leading bytes needed to match any maker note format.
+const int kMaxMakerNoteMagicSize = 16;
+
+// Returns the maker note format matching the specified header, or NULL if
+// the header matches no supported maker note format.
+const MakerNoteFormat* FindMakerNoteFormat(const QByteArray &header) {
+  int count = sizeof(kMakerNoteFormats) / sizeof(kMakerNoteFormats[0]);
+  for (int i = 0; i < count; ++i) {
+    const MakerNoteFormat &format = kMakerNoteFormats[i];
+    if (header.size() >= qMax(format.magic_size, format.byte_order_offset + 2)
+        && memcmp(header.constData(), format.magic, format.magic_size) == 0)
+      return &format;
+  }
+  return NULL;
+}
+
+// Returns true if the IFD with the specified entries contains raw sensor
+// data, which is either in a CFA or linear raw photometric interpretation
+// or compressed by a vendor raw compression scheme.
+bool HasRawData(TiffHeader *tiff_header,
+                const QVector<TiffHeader::IfdEntry> &entries);
+
+// Returns the first value of the entry with the specified tag in the
+// specified entries as an unsigned integer. Returns 0 if there is no such
+// entry or the entry is not of an unsigned integer type.
+quint64 UIntValue(TiffHeader *tiff_header,
+                  const QVector<TiffHeader::IfdEntry> &entries, int tag) {
+  const TiffHeader::IfdEntry *entry = TiffHeader::FindIfdEntry(entries, tag);
+  if (!entry)
+    return 0;
+  switch (entry->type) {
+    case TiffHeader::kShortType:
+    case TiffHeader::kLongType:
+    case TiffHeader::kIfdType:
+    case TiffHeader::kLong8Type:
+    case TiffHeader::kIfd8Type:
+      break;
+    default:
+      return 0;
+  }
+  return ExifData(tiff_header->IfdEntryValue(*entry), entry->type,
+                  1).ToUInt64();
+}
+
+bool HasRawData(TiffHeader *tiff_header,
+                const QVector<TiffHeader::IfdEntry> &entries) {
+  quint64 photometric_interpretation =
+      UIntValue(tiff_header, entries, Exif::kPhotometricInterpretation);
+  if (photometric_interpretation == kCfaPhotometricInterpretation ||
+      photometric_interpretation == kLinearRawPhotometricInterpretation)
+    return true;
+  quint64 compression = UIntValue(tiff_header, entries, Exif::kCompression);
+  int count = sizeof(kRawCompressions) / sizeof(kRawCompressions[0]);
+  for (int i = 0; i < count; ++i) {
+    if (compression == static_cast<quint64>(kRawCompressions[i]))
+      return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+Raw::Raw(QByteArray *data, Options options)
+    : Tiff(data, options), is_preview_searched_(false), preview_length_(0),
+      preview_offset_(0) {
+  GuessFileType();
+}
+
+Raw::Raw(QIODevice *file, Options options)
+    : Tiff(file, options), is_preview_searched_(false), preview_length_(0),
+      preview_offset_(0) {
+  GuessFileType();
+}
+
+Raw::Raw(const QString &file_name, Options options)
+    : Tiff(file_name, options), is_preview_searched_(false),
+      preview_length_(0), preview_offset_(0) {
+  GuessFileType();
+}
+
+// Appends the preview recorded in the specified maker note entry to the
+// specified previews if the maker note is in a supported format. Only the
+// header and one or two IFDs of the maker note are read.
+void Raw::AppendMakerNotePreviews(const TiffHeader::IfdEntry &maker_note,
+                                  PreviewList *previews) {
+  qint64 offset = tiff_header()->IfdEntryOffset(maker_note);
+  if (offset == -1)
+    return;
+  QByteArray header = ReadBytesAt(file(), offset, kMaxMakerNoteMagicSize);
+  const MakerNoteFormat *format = FindMakerNoteFormat(header);
+  if (!format)
+    return;
+
+  TiffHeader *ifd_header = tiff_header();
+  TiffHeader maker_note_header;
+  qint64 ifd_offset;
+  qint64 base_offset;
+  if (format->tiff_header_offset != -1) {
+    maker_note_header.set_limits(tiff_header()->limits());
+    if (!maker_note_header.Init(file(), offset + format->tiff_header_offset))
+      return;
+    ifd_header = &maker_note_header;
+    ifd_offset = ifd_header->first_ifd_offset();
+    base_offset = ifd_header->file_start_offset();
+  } else {
+    if (format->byte_order_offset != -1) {
+      QByteArray byte_order = header.mid(format->byte_order_offset, 2);
+      if (byte_order != (tiff_header()->endianness() == kBigEndians ?
+                         QByteArray("MM") : QByteArray("II")))
+        return;
+    }
+    ifd_offset = offset + format->ifd_offset;
+    base_offset = format->is_relative_to_maker_note ?
+                  offset : tiff_header()->file_start_offset();
+  }
+
+  QVector<TiffHeader::IfdEntry> entries = ifd_header->ReadIfd(ifd_offset);
+  if (format->preview_ifd_tag) {
+    quint64 preview_ifd_offset = UIntValue(ifd_header, entries,
+                                           format->preview_ifd_tag);
+    if (!preview_ifd_offset ||
+        preview_ifd_offset > static_cast<quint64>(file()->size()))
+      return;
+    entries = ifd_header->ReadIfd(base_offset + preview_ifd_offset);
+  }
+  quint64 preview_offset = UIntValue(ifd_header, entries,
+                                     format->preview_offset_tag);
+  quint64 preview_length = UIntValue(ifd_header, entries,
+                                     format->preview_length_tag);
+  if (preview_offset <= static_cast<quint64>(file()->size()) &&
+      preview_length <= static_cast<quint64>(file()->size()))
+    AppendPreview(base_offset + preview_offset, preview_length, previews);
+}
+
+// Appends the specified preview to the specified previews if it is within
+// the tracked file.
+void Raw::AppendPreview(qint64 offset, qint64 length, PreviewList *previews) {
+  if (offset <= 0 || length <= 0 || offset > file()->size() - length)
+    return;
+  previews->append(qMakePair(length, offset));
+}
+
+// Appends the JPEG previews of the IFD with the specified entries to the
+// specified previews. A preview is either recorded in the
+// JPEGInterchangeFormat tags, or is the single strip of an IFD compressed
+// in JPEG. Strips of raw sensor data are skipped, which are CR2 slices and
+// full-resolution DNG images.
+void Raw::AppendPreviews(const QVector<TiffHeader::IfdEntry> &entries,
+                         PreviewList *previews) {
+  qint64 start_offset = tiff_header()->file_start_offset();
+  quint64 offset = UIntValue(tiff_header(), entries,
+                             Exif::kJPEGInterchangeFormat);
+  quint64 length = UIntValue(tiff_header(), entries,
+                             Exif::kJPEGInterchangeFormatLength);
+  if (offset && offset <= static_cast<quint64>(file()->size()) &&
+      length <= static_cast<quint64>(file()->size()))
+    AppendPreview(start_offset + offset, length, previews);
+
+  quint64 compression = UIntValue(tiff_header(), entries,
+                                  Exif::kCompression);
+  bool is_reduced_resolution =
+      UIntValue(tiff_header(), entries, kNewSubfileTypeTag) & 1;
+  bool is_preview =
+      (compression == kOldJpegCompression &&
+       !TiffHeader::FindIfdEntry(entries, kCr2SliceTag)) ||
+      (compression == kJpegCompression && is_reduced_resolution);
+  if (!is_preview)
+    return;
+  const TiffHeader::IfdEntry *strip_offsets =
+      TiffHeader::FindIfdEntry(entries, Exif::kStripOffsets);
+  const TiffHeader::IfdEntry *strip_byte_counts =
+      TiffHeader::FindIfdEntry(entries, Exif::kStripByteCounts);
+  if (!strip_offsets || !strip_byte_counts ||
+      strip_offsets->count != 1 || strip_byte_counts->count != 1)
+    return;
+  offset = UIntValue(tiff_header(), entries, Exif::kStripOffsets);
+  length = UIntValue(tiff_header(), entries, Exif::kStripByteCounts);
+  if (offset && offset <= static_cast<quint64>(file()->size()) &&
+      length <= static_cast<quint64>(file()->size()))
+    AppendPreview(start_offset + offset, length, previews);
+}
+
+// Finds the largest embedded JPEG preview. The IFD chain, SubIFDs, the Exif
+// IFD and the maker note are searched, but no image data is read except the
+// first two bytes of the previews to verify the JPEG SOI marker. The result
+// is cached. Returns true if a preview is found.
+bool Raw::FindPreview(qint64 *offset, qint64 *length) {
+  if (!file() || !tiff_header())
+    return false;
+
+  if (!is_preview_searched_) {
+    is_preview_searched_ = true;
+    QList<int> pointer_tags;
+    pointer_tags << Exif::kSubIfds << Exif::kExifIfdPointer;
+    QList<TiffHeader::IfdNode> nodes = tiff_header()->Walk(pointer_tags);
+    PreviewList previews;
+    for (int i = 0; i < nodes.count(); ++i) {
+      const TiffHeader::IfdNode &node = nodes.at(i);
+      AppendPreviews(node.entries, &previews);
+      if (node.parent_tag != Exif::kExifIfdPointer)
+        continue;
+      const TiffHeader::IfdEntry *maker_note =
+          TiffHeader::FindIfdEntry(node.entries, Exif::kMakerNote);
+      if (maker_note)
+        AppendMakerNotePreviews(*maker_note, &previews);
+    }
+    qSort(previews.begin(), previews.end(),
+          qGreater<QPair<qint64, qint64> >());
+    for (int i = 0; i < previews.count(); ++i) {
+      qint64 preview_offset = previews.at(i).second;
+      if (ReadBytesAt(file(), preview_offset, 2) != QByteArray("\xff\xd8"))
+        continue;
+      preview_length_ = previews.at(i).first;
+      preview_offset_ = preview_offset;
+      break;
+    }
+  }
+  if (!preview_length_)
+    return false;
+  *offset = preview_offset_;
+  *length = preview_length_;
+  return true;
+}
+
+// Identifies the raw format of the tracked file. ORF and CR2 files are
+// identified by their TIFF headers, DNG files by the DNGVersion tag. Other
+// formats are identified by the make recorded in IFD0, but only if IFD0 or
+// one of its SubIFDs contains raw sensor data. Files of no known raw format
+// are TIFF files.
+void Raw::GuessFileType() {
+  set_file_type(kInvalidFileType);
+  if (!file() || !tiff_header())
+    return;
+
+  QByteArray header = ReadBytesAt(file(), 0, 10);
+  QByteArray version = header.mid(2, 2);
+  if (version == QByteArray("RO") || version == QByteArray("RS") ||
+      version == QByteArray("OR")) {
+    set_file_type(kOrfFileType);
+    return;
+  }
+  if (header.mid(8, 2) == QByteArray("CR")) {
+    set_file_type(kCr2FileType);
+    return;
+  }
+
+  // Reads IFD0 and its SubIFDs, where raw sensor data is stored.
+  QList<int> pointer_tags;
+  pointer_tags << Exif::kSubIfds;
+  QList<TiffHeader::IfdNode> nodes = tiff_header()->Walk(pointer_tags, 1);
+  if (nodes.isEmpty()) {
+    set_file_type(kTiffFileType);
+    return;
+  }
+  const QVector<TiffHeader::IfdEntry> &entries = nodes.first().entries;
+  if (TiffHeader::FindIfdEntry(entries, kDngVersionTag)) {
+    set_file_type(kDngFileType);
+    return;
+  }
+  set_file_type(kTiffFileType);
+  const TiffHeader::IfdEntry *make_entry =
+      TiffHeader::FindIfdEntry(entries, Exif::kMake);
+  if (!make_entry)
+    return;
+  QString make =
+      ExifData(tiff_header()->IfdEntryValue(*make_entry)).ToString().toUpper();
+  int count = sizeof(kRawMakes) / sizeof(kRawMakes[0]);
+  for (int i = 0; i < count; ++i) {
+    if (!make.startsWith(QLatin1String(kRawMakes[i].make)))
+      continue;
+    for (int j = 0; j < nodes.count(); ++j) {
+      if (HasRawData(tiff_header(), nodes.at(j).entries)) {
+        set_file_type(kRawMakes[i].file_type);
+        return;
+      }
+    }
+    return;
+  }
+}
+
+// Returns the byte data of the largest embedded JPEG preview, or an empty
+// byte array if there is none. The returned data owns its bytes.
+QByteArray Raw::Preview() {
+  return OwnedBytes(file(), PreviewView());
+}
+
+// Writes the largest embedded JPEG preview to the specified output without
+// holding the whole preview in memory. Returns true if the whole preview is
+// written.
+bool Raw::Preview(QIODevice *output) {
+  qint64 offset;
+  qint64 length;
+  if (!FindPreview(&offset, &length))
+    return false;
+  return CopyBytes(file(), offset, length, output) == length;
+}
+
+// Returns the preview like Preview(), but the returned data refers to the
+// file content without copying if the file is directly addressable, and is
+// only valid as long as this object exists and the file content is
+// unchanged.
+QByteArray Raw::PreviewView() {
+  qint64 offset;
+  qint64 length;
+  if (!FindPreview(&offset, &length))
+    return QByteArray();
+  return ReadBytesAt(file(), offset, length);
+}
+
+}  // namespace qmeta
@@ -25,7 +25,6 @@
 #include "qmeta/tiff.h"
 
 #include <QtCore>
-#include <qitty/byte_array.h>
 
 #include "qmeta/exif.h"
 #include "qmeta/iptc.h"
@@ -34,23 +33,44 @@
 
 namespace qmeta {
 
-Tiff::Tiff(QByteArray *data) : File(data) {
+Tiff::Tiff(QByteArray *data, Options options)
+    : File(data, options), tiff_header_(NULL) {
   Init();
 }
 
-Tiff::Tiff(QIODevice *file) : File(file) {
+Tiff::Tiff(QIODevice *file, Options options)
+    : File(file, options), tiff_header_(NULL) {
   Init();
 }
 
-Tiff::Tiff(const QString &file_name) : File(file_name) {
+Tiff::Tiff(const QString &file_name, Options options)
+    : File(file_name, options), tiff_header_(NULL) {
   Init();
 }
 
+// Returns all IFDs of the tracked file in the order visited: the pages in
+// the chain starting from the first IFD, their SubIFDs, and their Exif, GPS,
+// and Interoperability IFDs. Parent indexes and tags of the returned IFDs
+// tell how each IFD was reached. The traversal stops at the limits of the
+// TiffHeader object.
+QList<TiffHeader::IfdNode> Tiff::Ifds() {
+  if (!tiff_header())
+    return QList<TiffHeader::IfdNode>();
+
+  QList<int> pointer_tags;
+  pointer_tags << Exif::kSubIfds << Exif::kExifIfdPointer
+               << Exif::kGpsInfoIfdPointer
+               << Exif::kInteroperabilityIfdPointer;
+  return tiff_header()->Walk(pointer_tags);
+}
+
 // Initializes the Tiff object.
 void Tiff::Init() {
+  set_tiff_header(NULL);
   if (!file())
     return;
 
+  PrefetchHeader();
   TiffHeader *tiff_header = new TiffHeader(this);
   if (tiff_header->Init(file(), 0))
     set_tiff_header(tiff_header);
@@ -71,12 +91,23 @@ bool Tiff::IsValid() {
     return false;
 }
 
+// Returns the number of pages, which are the IFDs in the chain starting from
+// the first IFD. Only the entry count and the next IFD pointer of each IFD
+// are read, no entry is decoded. Counting stops at the first IFD visited
+// twice and at the IFD count limit of the TiffHeader object.
+int Tiff::PageCount() {
+  if (!tiff_header())
+    return 0;
+  return tiff_header()->ChainLength();
+}
+
 // Reimplements the File::InitExif().
 void Tiff::InitExif() {
   if (tiff_header()) {
     // Creates the Exif object.
     Exif *exif = new Exif(this);
-    if (exif->Init(file(), tiff_header()))
+    if (exif->Init(file(), tiff_header(),
+                   !(options() & kExifOption)))
       set_exif(exif);
     else
       delete exif;
@@ -85,24 +116,14 @@ void Tiff::InitExif() {
 
 // Reimplements the File::InitIptc().
 void Tiff::InitIptc() {
-  tiff_header()->ToFirstIfd();
-  // Creates a variable used to save the offset of the IPTC data. This value
-  // will be overwritten if the IPTC data is found.
-  qint64 iptc_offset = -1;
   // Finds the IPTC data from the TIFF header. IPTC offset is recorded in
   // the "IPTC dataset" tag, and represented as 33723 in decimal.
-  while (tiff_header()->HasNextIfdEntry()) {
-    qint64 ifd_entry_offset = tiff_header()->NextIfdEntryOffset();
-    int tag = tiff_header()->IfdEntryTag(ifd_entry_offset);
-    if (tag == 33723) {
-      iptc_offset = tiff_header()->IfdEntryOffset(ifd_entry_offset);
-      break;
-    }
-  }
+  qint64 iptc_size = 0;
+  qint64 iptc_offset = FindIfdEntryOffset(33723, &iptc_size);
   if (iptc_offset != -1) {
     // Creates the Iptc object.
     Iptc *iptc = new Iptc(this);
-    if (iptc->Init(file(), iptc_offset))
+    if (iptc->Init(file(), iptc_offset, iptc_size))
       set_iptc(iptc);
     else
       delete iptc;
@@ -111,28 +132,52 @@ void Tiff::InitIptc() {
 
 // Reimplements the File::InitXmp().
 void Tiff::InitXmp() {
-  tiff_header()->ToFirstIfd();
-  // Creates a variable used to save the offset of the XMP packet. This value
-  // will be overwritten if the XMP packet is found.
-  qint64 xmp_offset = -1;
   // Finds the XMP packet from the TIFF header. XMP offset is recorded in
   // the "XMP packet" tag, and represented as 700 in decimal.
-  while (tiff_header()->HasNextIfdEntry()) {
-    qint64 ifd_entry_offset = tiff_header()->NextIfdEntryOffset();
-    int tag = tiff_header()->IfdEntryTag(ifd_entry_offset);
-    if (tag == 700) {
-      xmp_offset = tiff_header()->IfdEntryOffset(ifd_entry_offset);
-      break;
-    }
-  }
+  qint64 xmp_size = 0;
+  qint64 xmp_offset = FindIfdEntryOffset(700, &xmp_size);
   if (xmp_offset != -1) {
     // Creates the Xmp object.
     Xmp *xmp = new Xmp(this);
-    if (xmp->Init(file(), xmp_offset))
+    if (xmp->Init(file(), xmp_offset, xmp_size))
       set_xmp(xmp);
     else
       delete xmp;
   }
 }
 
+// Returns the value offset of the first entry with the specified tag in the
+// chain of IFDs starting from the first IFD. If size is not NULL, it is set
+// to the number of bytes of the value. Returns -1 if the tag is not found,
+// its value is not an offset, or the value exceeds the tracked file or the
+// value size limit of the TiffHeader object. The chain ends at the first IFD
+// visited twice.
+qint64 Tiff::FindIfdEntryOffset(int tag, qint64 *size) {
+  qint64 ifd_offset = tiff_header()->first_ifd_offset();
+  QSet<qint64> visited_ifd_offsets;
+  while (ifd_offset != -1 && !visited_ifd_offsets.contains(ifd_offset) &&
+         visited_ifd_offsets.count() < tiff_header()->limits().max_ifd_count) {
+    visited_ifd_offsets.insert(ifd_offset);
+    qint64 next_ifd_offset;
+    QVector<TiffHeader::IfdEntry> entries =
+        tiff_header()->ReadIfd(ifd_offset, &next_ifd_offset);
+    const TiffHeader::IfdEntry *entry =
+        TiffHeader::FindIfdEntry(entries, tag);
+    if (entry) {
+      // The size comes from the file, so the value is checked against the
+      // file and the limits before anything is read.
+      qint64 value_size = tiff_header()->IfdEntryValueSize(*entry);
+      qint64 value_offset = tiff_header()->IfdEntryOffset(*entry);
+      if (value_offset == -1 ||
+          !tiff_header()->ReserveValue(value_offset, value_size))
+        return -1;
+      if (size)
+        *size = value_size;
+      return value_offset;
+    }
+    ifd_offset = next_ifd_offset;
+  }
+  return -1;
+}
+
 }  // namespace qmeta
@@ -25,14 +25,52 @@
 #include "qmeta/tiff_header.h"
 
 #include <QtCore>
-#include <qitty/byte_array.h>
+
+#include "qmeta/byte_order.h"
+#include "qmeta/io.h"
 
 namespace qmeta {
 
-TiffHeader::TiffHeader(QObject *parent) : QObject(parent) {
+namespace {
+
+// Returns true if the tag of the first entry is less than the second's.
+bool IfdEntryLessThan(const TiffHeader::IfdEntry &entry1,
+                      const TiffHeader::IfdEntry &entry2) {
+  return entry1.tag < entry2.tag;
+}
+
+}  // namespace
+
+// The default limits are far above what any camera or scanner writes.
+TiffHeader::Limits::Limits()
+    : max_ifd_count(65536), max_entry_count(1024 * 1024), max_depth(4),
+      max_value_size(64 * 1024 * 1024) {}
+
+TiffHeader::TiffHeader(QObject *parent)
+    : QObject(parent), is_big_tiff_(false), is_truncated_(false),
+      value_size_(0) {
   InitTypeByteUnit();
 }
 
+// Returns the number of IFDs in the chain starting from the first IFD by
+// hopping the next IFD pointers. Only the entry count and the next
+// IFD pointer of each IFD are read. The chain ends at the first IFD visited
+// twice or outside the tracked file, and at the IFD count limit.
+int TiffHeader::ChainLength() {
+  QSet<qint64> visited_offsets;
+  qint64 ifd_offset = first_ifd_offset();
+  while (ifd_offset != -1 && IsInFile(ifd_offset, EntryCountSize())) {
+    if (visited_offsets.contains(ifd_offset) ||
+        visited_offsets.count() >= limits().max_ifd_count) {
+      set_truncated(true);
+      break;
+    }
+    visited_offsets.insert(ifd_offset);
+    ifd_offset = NextIfdOffset(ifd_offset);
+  }
+  return visited_offsets.count();
+}
+
 // Returns true if next IFD entry exists.
 bool TiffHeader::HasNextIfdEntry() {
   if (current_entry_number() < current_entry_count())
@@ -41,69 +79,104 @@ bool TiffHeader::HasNextIfdEntry() {
     return false;
 }
 
+// Returns the entry with the specified tag in the specified entries, which
+// must be sorted by tag as returned by ReadIfd(). Returns NULL if not found.
+const TiffHeader::IfdEntry* TiffHeader::FindIfdEntry(
+    const QVector<IfdEntry> &entries, int tag) {
+  int low = 0;
+  int high = entries.count() - 1;
+  while (low <= high) {
+    int middle = (low + high) / 2;
+    int middle_tag = entries.at(middle).tag;
+    if (middle_tag < tag)
+      low = middle + 1;
+    else if (middle_tag > tag)
+      high = middle - 1;
+    else
+      return &entries.at(middle);
+  }
+  return NULL;
+}
+
 // Returns the Tag of the entry at the specified entry_offset in decimal.
 int TiffHeader::IfdEntryTag(qint64 ifd_entry_offset) {
-  file()->seek(ifd_entry_offset);
-  return ReadFromFile(2).toHex().toInt(NULL, 16);
+  QByteArray entry = ReadIfdEntry(ifd_entry_offset);
+  if (entry.size() < EntrySize())
+    return -1;
+  return DecodeUInt16(entry.constData(), endianness());
 }
 
 // Returns the Type of the entry at the specified entry_offset.
 TiffHeader::Type TiffHeader::IfdEntryType(qint64 ifd_entry_offset) {
-  file()->seek(ifd_entry_offset + 2);
-  return static_cast<Type>(ReadFromFile(2).toHex().toInt(NULL, 16));
+  QByteArray entry = ReadIfdEntry(ifd_entry_offset);
+  if (entry.size() < EntrySize())
+    return kUnknownType;
+  return static_cast<Type>(DecodeUInt16(entry.constData() + 2, endianness()));
 }
 
 // Returns the value of the entry at the specified entry_offset. Note that
 // the returned value is always in the big-endian byte order.
 QByteArray TiffHeader::IfdEntryValue(qint64 ifd_entry_offset) {
-  Type type = IfdEntryType(ifd_entry_offset);
-  int count = ReadFromFile(4).toHex().toInt(NULL, 16);
-  // Retrieves the byte unit of the specified type.
-  int current_type_byte_unit = type_byte_unit().value(type);
-  // Calculates the number of bytes used for the entry value.
-  int value_byte_count = current_type_byte_unit * count;
-  // Jumps to the offset containing the entry value if the byte count > 4.
-  if (value_byte_count > 4) {
-    qint64 offset = ReadFromFile(4).toHex().toInt(NULL, 16) +
-                    file_start_offset();
-    file()->seek(offset);
-  }
+  QByteArray entry = ReadIfdEntry(ifd_entry_offset);
+  if (entry.size() < EntrySize())
+    return QByteArray();
+  QVector<IfdEntry> entries;
+  DecodeIfdEntries(entry.constData(), 1, ifd_entry_offset, &entries);
+  return IfdEntryValue(entries.first());
+}
 
+// Returns the value of the specified entry. Note that the returned value is
+// always in the big-endian byte order. Values fitting in the value field are
+// taken from the entry without any I/O. For big-endian files and single-byte
+// types, the returned value refers to the file content without copying if
+// the file is directly addressable.
+QByteArray TiffHeader::IfdEntryValue(const IfdEntry &entry) {
   QByteArray value;
-  if (current_type_byte_unit == 1) {
-    value = file()->read(value_byte_count);
+  // Retrieves the byte unit of the specified type.
+  int current_type_byte_unit = type_byte_unit().value(entry.type);
+  // Calculates the number of bytes used for the entry value.
+  qint64 value_byte_count = IfdEntryValueSize(entry);
+  // The value is stored in the entry itself if it fits in the value field,
+  // otherwise the entry contains the offset of the value.
+  if (value_byte_count <= OffsetSize()) {
+    value = QByteArray(entry.value_field, value_byte_count);
   } else {
-    for (int i = 0; i < count; ++i) {
-      // If the specified type is RATIONAL or SRATIONAL, read 4 bytes twice
-      // for double LONG or double SLONG, respectively.
-      if (current_type_byte_unit == 8) {
-        value.append(ReadFromFile(4));
-        value.append(ReadFromFile(4));
-      } else {
-        value.append(ReadFromFile(current_type_byte_unit));
-      }
-    }
+    // The size comes from the file, so it is checked against the file and
+    // the limits before anything is allocated.
+    qint64 offset = DecodeOffset(entry.value_field) + file_start_offset();
+    if (!ReserveValue(offset, value_byte_count))
+      return value;
+    value = ReadBytesAt(file(), offset, value_byte_count);
   }
+
+  // Converts each unit of the value to the big-endian byte order.
+  if (endianness() == kLittleEndians && current_type_byte_unit > 1)
+    value = ToBigEndian(value, ValueUnitSize(entry.type));
   return value;
 }
 
 // Returns the value offset for the IFD entry at the specified ifd_entry_offset.
 // Returns -1 if the if the value is not an offset.
 qint64 TiffHeader::IfdEntryOffset(qint64 ifd_entry_offset) {
-  Type type = IfdEntryType(ifd_entry_offset);
-  int count = ReadFromFile(4).toHex().toInt(NULL, 16);
-  // Retrieves the byte unit of the specified type.
-  int current_type_byte_unit = type_byte_unit().value(type);
+  QByteArray entry = ReadIfdEntry(ifd_entry_offset);
+  if (entry.size() < EntrySize())
+    return -1;
+  QVector<IfdEntry> entries;
+  DecodeIfdEntries(entry.constData(), 1, ifd_entry_offset, &entries);
+  return IfdEntryOffset(entries.first());
+}
+
+// Returns the value offset for the specified entry. Returns -1 if the value
+// is not an offset.
+qint64 TiffHeader::IfdEntryOffset(const IfdEntry &entry) {
   // Calculates the number of bytes used for the entry value.
-  int value_byte_count = current_type_byte_unit * count;
-  // Jumps to the offset containing the entry value if the byte count > 4.
-  if (value_byte_count > 4) {
-    qint64 offset = ReadFromFile(4).toHex().toInt(NULL, 16) +
-                    file_start_offset();
-    return offset;
-  } else {
+  qint64 value_byte_count = IfdEntryValueSize(entry);
+  // The entry contains the offset of the value if the value does not fit
+  // in the value field.
+  if (value_byte_count > OffsetSize())
+    return DecodeOffset(entry.value_field) + file_start_offset();
+  else
     return -1;
-  }
 }
 
 // Initializes the TiffHeader object. Returns true if successful.
@@ -112,35 +185,137 @@ bool TiffHeader::Init(QIODevice *file, qint64 file_start_offset) {
 
   file->seek(file_start_offset);
   // Determines the byte order in the specified file.
-  QByteArray byte_order = file->read(2);
-  if (byte_order == "II")
+  QByteArray byte_order = ReadBytes(file, 2);
+  if (byte_order == QByteArray("II"))
     set_endianness(kLittleEndians);
-  else if (byte_order == "MM")
+  else if (byte_order == QByteArray("MM"))
     set_endianness(kBigEndians);
   else
     return false;
 
   // Further identifies whether the specified file has a valid TIFF header.
-  // Reads the next two bytes which should have the value of 42 in decimal.
-  if (ReadFromFile(2).toHex().toInt(NULL, 16) != 42)
+  // Reads the next two bytes which should have the value of 42 in decimal,
+  // or 43 for BigTIFF. Olympus ORF files use "RO" or "RS" instead of 42
+  // with the structure of TIFF.
+  quint16 version = ReadUInt16();
+  qint64 first_ifd_offset;
+  if (version == 42 || version == 0x4f52 || version == 0x5352) {
+    set_big_tiff(false);
+    // Reads the next four bytes to determine the offset of the first IFD,
+    // which is relative to the beginning of the TIFF header. For JPEG files,
+    // if the TIFF header is followed immediately by the first IFD, it is
+    // written as 00000008 in hexidecimal.
+    first_ifd_offset = ReadUInt32();
+  } else if (version == 43) {
+    // The byte size of offsets, which is always 8, and a reserved 0 precede
+    // the 8-byte offset of the first IFD in BigTIFF.
+    if (ReadUInt16() != 8 || ReadUInt16() != 0)
+      return false;
+    set_big_tiff(true);
+    quint64 offset = ReadUInt64();
+    if (offset > static_cast<quint64>(file->size()))
+      return false;
+    first_ifd_offset = static_cast<qint64>(offset);
+  } else {
     return false;
-
-  // Reads the next four bytes to determine the offset of the first IFD.
-  int first_ifd_offset = ReadFromFile(4).toHex().toInt(NULL, 16);
-  // Sets the offset to the current position if the read value equals to 8.
-  // The reason is for JPEG files, if the TIFF header is followed immediately
-  // by the first IFD, it is written as 00000008 in hexidecimal.
-  if (first_ifd_offset == 8)
-    first_ifd_offset = file->pos();
+  }
+  first_ifd_offset += file_start_offset;
 
   // Sets properties.
   set_file_start_offset(file_start_offset);
   set_first_ifd_offset(first_ifd_offset);
+  value_size_ = 0;
   // Jumps to the first IFD by default.
   ToFirstIfd();
   return true;
 }
 
+// Decodes the specified count of IFD entries from the specified data in the
+// byte order and the format of the file, and appends them to entries. The
+// offset is the offset of the first entry in the tracked file. The decoding
+// loop is instantiated once per byte order and format so no check is done
+// per field.
+void TiffHeader::DecodeIfdEntries(const char *data, int count, qint64 offset,
+                                  QVector<IfdEntry> *entries) const {
+  if (endianness() == kBigEndians) {
+    if (is_big_tiff())
+      DecodeIfdEntries<kBigEndians, true>(data, count, offset, entries);
+    else
+      DecodeIfdEntries<kBigEndians, false>(data, count, offset, entries);
+  } else {
+    if (is_big_tiff())
+      DecodeIfdEntries<kLittleEndians, true>(data, count, offset, entries);
+    else
+      DecodeIfdEntries<kLittleEndians, false>(data, count, offset, entries);
+  }
+}
+
+// Decodes the specified count of IFD entries from the specified data in the
+// byte order of kByteOrder. Entries are 20 bytes with 8-byte counts and
+// value fields if kIsBigTiff is true, otherwise 12 bytes with 4-byte counts
+// and value fields.
+template <Endianness kByteOrder, bool kIsBigTiff>
+void TiffHeader::DecodeIfdEntries(const char *data, int count, qint64 offset,
+                                  QVector<IfdEntry> *entries) {
+  const int kEntrySize = kIsBigTiff ? 20 : 12;
+  for (int i = 0; i < count; ++i) {
+    const char *entry_data = data + i * kEntrySize;
+    IfdEntry entry;
+    entry.tag = DecodeUInt16<kByteOrder>(entry_data);
+    entry.type = static_cast<Type>(DecodeUInt16<kByteOrder>(entry_data + 2));
+    if (kIsBigTiff) {
+      entry.count = DecodeUInt64<kByteOrder>(entry_data + 4);
+      memcpy(entry.value_field, entry_data + 12, 8);
+    } else {
+      entry.count = DecodeUInt32<kByteOrder>(entry_data + 4);
+      memcpy(entry.value_field, entry_data + 8, 4);
+      memset(entry.value_field + 4, 0, 4);
+    }
+    entry.offset = offset + static_cast<qint64>(i) * kEntrySize;
+    entries->append(entry);
+  }
+}
+
+// Decodes the offset at the specified data, which is 8 bytes in BigTIFF and
+// 4 bytes otherwise, in the byte order of the file. Returns -1 if the offset
+// does not fit in qint64.
+qint64 TiffHeader::DecodeOffset(const char *data) const {
+  quint64 offset;
+  if (is_big_tiff())
+    offset = DecodeUInt64(data, endianness());
+  else
+    offset = DecodeUInt32(data, endianness());
+  if (offset > static_cast<quint64>(Q_INT64_C(0x7fffffffffffffff)))
+    return -1;
+  return static_cast<qint64>(offset);
+}
+
+// Returns the size of the entry count preceding the entries of an IFD.
+int TiffHeader::EntryCountSize() const {
+  return is_big_tiff() ? 8 : 2;
+}
+
+// Returns the size of an IFD entry.
+int TiffHeader::EntrySize() const {
+  return is_big_tiff() ? 20 : 12;
+}
+
+// Returns the number of bytes used for the value of the specified entry.
+// Counts that cannot occur in any file are clamped so the size does not
+// overflow.
+qint64 TiffHeader::IfdEntryValueSize(const IfdEntry &entry) {
+  quint64 count = qMin(entry.count, Q_UINT64_C(1) << 56);
+  return static_cast<qint64>(type_byte_unit().value(entry.type)) *
+         static_cast<qint64>(count);
+}
+
+// Returns true if the specified size of bytes at the specified offset lies
+// within the tracked file after the beginning of the TIFF header.
+bool TiffHeader::IsInFile(qint64 offset, qint64 size) const {
+  return offset >= file_start_offset() && size >= 0 &&
+         offset <= file()->size() - size;
+}
+
 // Initializes the type_byte_unit_ property.
 void TiffHeader::InitTypeByteUnit() {
   QHash<Type, int> type_byte_unit;
@@ -156,6 +331,10 @@ void TiffHeader::InitTypeByteUnit() {
   type_byte_unit.insert(kSRationalType, 8);
   type_byte_unit.insert(kFloat, 4);
   type_byte_unit.insert(kDouble, 8);
+  type_byte_unit.insert(kIfdType, 4);
+  type_byte_unit.insert(kLong8Type, 8);
+  type_byte_unit.insert(kSLong8Type, 8);
+  type_byte_unit.insert(kIfd8Type, 8);
   set_type_byte_unit(type_byte_unit);
 }
 
@@ -165,32 +344,245 @@ qint64 TiffHeader::NextIfdEntryOffset() {
   if (current_entry_number() == current_entry_count())
     return -1;
 
-  qint64 entry_offset = current_ifd_offset() + 2 + current_entry_number() * 12;
+  qint64 entry_offset = current_ifd_offset() + EntryCountSize() +
+                        static_cast<qint64>(current_entry_number()) *
+                        EntrySize();
   // Increases the current entry number by 1.
   set_current_entry_number(current_entry_number() + 1);
   // If already reaches the end of the current IFD. Jumps to the next IFD if
   // available.
+  // Visited IFDs are not jumped to again so a cyclic chain ends.
   if (current_entry_number() == current_entry_count()) {
-    file()->seek(current_ifd_offset() + 2 + current_entry_count() * 12);
-    qint64 next_ifd_offset = ReadFromFile(4).toHex().toInt(NULL, 16);
-    if (next_ifd_offset != 0)
-      ToIfd(next_ifd_offset + file_start_offset());
+    QByteArray offset_data = ReadBytesAt(
+        file(), current_ifd_offset() + EntryCountSize() +
+                static_cast<qint64>(current_entry_count()) * EntrySize(),
+        OffsetSize());
+    qint64 next_ifd_offset = 0;
+    if (offset_data.size() == OffsetSize())
+      next_ifd_offset = DecodeOffset(offset_data.constData());
+    if (next_ifd_offset > 0) {
+      next_ifd_offset += file_start_offset();
+      if (visited_ifd_offsets_.contains(next_ifd_offset) ||
+          visited_ifd_offsets_.count() >= limits().max_ifd_count)
+        set_truncated(true);
+      else
+        ToIfd(next_ifd_offset);
+    }
   }
   return entry_offset;
 }
 
-// Reads at most max_size bytes from the tracked file object, and returns the
-// data read as a QByteArray in big-endian byte order.
-QByteArray TiffHeader::ReadFromFile(const int max_size) {
-  QByteArray data = file()->read(max_size);
-  if (endianness() == kLittleEndians)
-    data = qitty_utils::ReverseByteArray(data);
-  return data;
+// Reads and decodes all entries of the IFD at the specified ifd_offset with
+// a single read of the entry block. The returned entries are sorted by tag so
+// they can be searched with FindIfdEntry(). If next_ifd_offset is not NULL,
+// it is set to the offset of the next IFD, or -1 if there is no next IFD.
+QVector<TiffHeader::IfdEntry> TiffHeader::ReadIfd(qint64 ifd_offset,
+                                                  qint64 *next_ifd_offset) {
+  QVector<IfdEntry> entries;
+  if (next_ifd_offset)
+    *next_ifd_offset = -1;
+
+  qint64 count = ReadEntryCount(ifd_offset);
+  if (count < 0) {
+    set_truncated(true);
+    return entries;
+  }
+  // The count comes from the file, so it is clamped to the entries that fit
+  // in the file and to the limits before anything is allocated.
+  qint64 entries_offset = ifd_offset + EntryCountSize();
+  qint64 available_size = file()->size() - entries_offset;
+  bool is_truncated = count * EntrySize() + OffsetSize() > available_size;
+  count = qMin(count, available_size / EntrySize());
+  if (count > limits().max_entry_count) {
+    is_truncated = true;
+    count = limits().max_entry_count;
+  }
+  if (is_truncated)
+    set_truncated(true);
+  // Reads all entries followed by the offset of the next IFD.
+  QByteArray block = ReadBytesAt(file(), entries_offset,
+                                 count * EntrySize() +
+                                 (is_truncated ? 0 : OffsetSize()));
+  // Ignores truncated entries at the end of the file.
+  count = qMin(count, static_cast<qint64>(block.size() / EntrySize()));
+  entries.reserve(static_cast<int>(count));
+  const char *data = block.constData();
+  DecodeIfdEntries(data, static_cast<int>(count), entries_offset, &entries);
+  // Entries are supposed to be sorted in ascending order by tag, but not
+  // every writer follows the specification.
+  qSort(entries.begin(), entries.end(), IfdEntryLessThan);
+
+  if (next_ifd_offset && !is_truncated &&
+      block.size() >= count * EntrySize() + OffsetSize()) {
+    qint64 offset = DecodeOffset(data + count * EntrySize());
+    if (offset > 0)
+      *next_ifd_offset = offset + file_start_offset();
+  }
+  return entries;
+}
+
+// Returns the offset of the IFD following the IFD at the specified
+// ifd_offset without decoding its entries. Only the entry count and the
+// next IFD pointer are read. Returns -1 if there is no next IFD.
+qint64 TiffHeader::NextIfdOffset(qint64 ifd_offset) {
+  qint64 count = ReadEntryCount(ifd_offset);
+  if (count < 0 || count > file()->size() / EntrySize())
+    return -1;
+  QByteArray offset_data = ReadBytesAt(
+      file(), ifd_offset + EntryCountSize() + count * EntrySize(),
+      OffsetSize());
+  if (offset_data.size() < OffsetSize())
+    return -1;
+  qint64 offset = DecodeOffset(offset_data.constData());
+  if (offset <= 0)
+    return -1;
+  return offset + file_start_offset();
+}
+
+// Returns the size of offsets, which is 8 bytes in BigTIFF and 4 bytes
+// otherwise. It is also the size of the value field of IFD entries.
+int TiffHeader::OffsetSize() const {
+  return is_big_tiff() ? 8 : 4;
+}
+
+// Returns the number of entries of the IFD at the specified ifd_offset, or
+// -1 if the count is outside the tracked file.
+qint64 TiffHeader::ReadEntryCount(qint64 ifd_offset) {
+  if (!IsInFile(ifd_offset, EntryCountSize()))
+    return -1;
+  QByteArray count_data = ReadBytesAt(file(), ifd_offset, EntryCountSize());
+  if (count_data.size() < EntryCountSize())
+    return -1;
+  if (!is_big_tiff())
+    return DecodeUInt16(count_data.constData(), endianness());
+  quint64 count = DecodeUInt64(count_data.constData(), endianness());
+  return static_cast<qint64>(qMin(count, Q_UINT64_C(1) << 56));
+}
+
+// Reserves the specified size of value bytes at the specified offset before
+// they are read. Returns true if the bytes lie within the tracked file and
+// fit in the remaining budget of value bytes, which is then reduced.
+// Otherwise returns false, in which case is_truncated() returns true
+// afterwards.
+bool TiffHeader::ReserveValue(qint64 offset, qint64 size) {
+  if (!IsInFile(offset, size) ||
+      size > limits().max_value_size - value_size_) {
+    set_truncated(true);
+    return false;
+  }
+  value_size_ += size;
+  return true;
+}
+
+// Overwrites the value of the specified entry in place. The value must be in
+// the big-endian byte order as returned by IfdEntryValue(), and consist of
+// count values of the entry type. A value that fits in the value field is
+// written to the entry itself, a larger value is written over the original
+// value, which must be at least as large. Only the value bytes and, if
+// changed, the count field are written, and the specified entry is updated
+// accordingly. Returns false if the value doesn't fit or the tracked file
+// cannot be written.
+bool TiffHeader::SetIfdEntryValue(IfdEntry *entry, const QByteArray &value,
+                                  quint64 count) {
+  int type_byte_unit = this->type_byte_unit().value(entry->type);
+  if (type_byte_unit == 0 ||
+      static_cast<quint64>(value.size()) !=
+          static_cast<quint64>(type_byte_unit) * count)
+    return false;
+
+  QByteArray file_value = value;
+  if (endianness() == kLittleEndians && type_byte_unit > 1)
+    file_value = ToBigEndian(value, ValueUnitSize(entry->type));
+  // The count field follows the tag and the type, and has the same size as
+  // the value field that follows it.
+  if (file_value.size() <= OffsetSize()) {
+    file_value.append(QByteArray(OffsetSize() - file_value.size(), '\0'));
+    if (!WriteBytesAt(file(), entry->offset + 4 + OffsetSize(), file_value))
+      return false;
+    memcpy(entry->value_field, file_value.constData(), OffsetSize());
+  } else {
+    qint64 original_size = IfdEntryValueSize(*entry);
+    if (file_value.size() > original_size)
+      return false;
+    if (!WriteBytesAt(file(), IfdEntryOffset(*entry), file_value))
+      return false;
+  }
+
+  if (count != entry->count) {
+    char count_field[8];
+    if (is_big_tiff())
+      EncodeUInt64(count, endianness(), count_field);
+    else
+      EncodeUInt32(static_cast<quint32>(count), endianness(), count_field);
+    if (!WriteBytesAt(file(), entry->offset + 4,
+                      QByteArray(count_field, OffsetSize())))
+      return false;
+    entry->count = count;
+  }
+  return true;
+}
+
+// Reads the IFD entry at the specified ifd_entry_offset in one read.
+// The returned data is in the byte order of the file, and refers to the file
+// content without copying if the file is directly addressable.
+QByteArray TiffHeader::ReadIfdEntry(qint64 ifd_entry_offset) {
+  return ReadBytesAt(file(), ifd_entry_offset, EntrySize());
+}
+
+// Reads a 16-bit unsigned integer in the byte order of the file from the
+// current position of the tracked file. Returns 0 if failed.
+quint16 TiffHeader::ReadUInt16() {
+  if (endianness() == kBigEndians)
+    return qmeta::ReadUInt16<kBigEndians>(file());
+  else
+    return qmeta::ReadUInt16<kLittleEndians>(file());
+}
+
+// Reads a 32-bit unsigned integer in the byte order of the file from the
+// current position of the tracked file. Returns 0 if failed.
+quint32 TiffHeader::ReadUInt32() {
+  if (endianness() == kBigEndians)
+    return qmeta::ReadUInt32<kBigEndians>(file());
+  else
+    return qmeta::ReadUInt32<kLittleEndians>(file());
+}
+
+// Reads a 64-bit unsigned integer in the byte order of the file from the
+// current position of the tracked file. Returns 0 if failed.
+quint64 TiffHeader::ReadUInt64() {
+  if (endianness() == kBigEndians)
+    return qmeta::ReadUInt64<kBigEndians>(file());
+  else
+    return qmeta::ReadUInt64<kLittleEndians>(file());
+}
+
+// Returns a copy of the specified data with the byte order of each unit of
+// unit_size bytes reversed.
+QByteArray TiffHeader::ToBigEndian(const QByteArray &data, int unit_size) {
+  QByteArray result(data.size(), 0);
+  const char *source = data.constData();
+  char *destination = result.data();
+  int size = data.size() - data.size() % unit_size;
+  for (int i = 0; i < size; i += unit_size) {
+    for (int j = 0; j < unit_size; ++j)
+      destination[i + j] = source[i + unit_size - 1 - j];
+  }
+  return result;
+}
+
+// Returns the size of the units that are byte-swapped in values of the
+// specified type. RATIONAL and SRATIONAL values consist of two LONGs or
+// SLONGs respectively.
+int TiffHeader::ValueUnitSize(Type type) {
+  if (type == kRationalType || type == kSRationalType)
+    return 4;
+  return type_byte_unit().value(type);
 }
 
 // Jumps to the offset of the first IFD and sets the current_entry_number_ and
 // the entry_count_ properties.
 void TiffHeader::ToFirstIfd() {
+  visited_ifd_offsets_.clear();
   ToIfd(first_ifd_offset());
 }
 
@@ -198,10 +590,106 @@ void TiffHeader::ToFirstIfd() {
 // the entry_count_ properties. The specified offset must point to the beginning
 // of a valid IFD.
 void TiffHeader::ToIfd(qint64 offset) {
-  file()->seek(offset);
+  visited_ifd_offsets_.insert(offset);
   set_current_ifd_offset(offset);
-  set_current_entry_count(ReadFromFile(2).toHex().toInt(NULL, 16));
   set_current_entry_number(0);
+  qint64 count = ReadEntryCount(offset);
+  if (count < 0) {
+    set_truncated(true);
+    count = 0;
+  }
+  set_current_entry_count(static_cast<int>(
+      qMin(count, static_cast<qint64>(limits().max_entry_count))));
+}
+
+// Visits the IFDs of the TIFF structure iteratively and returns them in the
+// order visited. The chain of IFDs starting from the first IFD is followed
+// through the next IFD pointers, up to max_chain_length IFDs if it is not
+// negative, and the IFDs pointed to by entries with any of the specified
+// pointer_tags are visited from every IFD. Each IFD is visited once, and
+// IFDs outside the tracked file or beyond the limits are skipped, in which
+// case is_truncated() returns true afterwards. The budget of value bytes is
+// restarted for the values read after the walk.
+QList<TiffHeader::IfdNode> TiffHeader::Walk(const QList<int> &pointer_tags,
+                                            int max_chain_length) {
+  value_size_ = 0;
+  QList<IfdNode> nodes;
+  // The IFDs to visit. Their entries are read when they are visited.
+  QList<IfdNode> pending_nodes;
+  IfdNode first_node;
+  first_node.offset = first_ifd_offset();
+  first_node.parent = -1;
+  first_node.parent_tag = 0;
+  first_node.depth = 0;
+  pending_nodes.append(first_node);
+  QSet<qint64> visited_offsets;
+  int chain_length = 0;
+  int entry_count = 0;
+
+  while (!pending_nodes.isEmpty()) {
+    IfdNode node = pending_nodes.takeFirst();
+    if (visited_offsets.contains(node.offset) ||
+        nodes.count() >= limits().max_ifd_count ||
+        entry_count >= limits().max_entry_count) {
+      set_truncated(true);
+      continue;
+    }
+    visited_offsets.insert(node.offset);
+    qint64 next_ifd_offset;
+    node.entries = ReadIfd(node.offset, &next_ifd_offset);
+    entry_count += node.entries.count();
+    int index = nodes.count();
+    nodes.append(node);
+
+    // Follows the chain starting from the first IFD.
+    if (node.parent == -1 && next_ifd_offset != -1 &&
+        (max_chain_length < 0 || ++chain_length < max_chain_length)) {
+      IfdNode next_node;
+      next_node.offset = next_ifd_offset;
+      next_node.parent = -1;
+      next_node.parent_tag = 0;
+      next_node.depth = 0;
+      pending_nodes.append(next_node);
+    }
+
+    // Follows the IFD pointers. An entry may point to more than one IFD.
+    for (int i = 0; i < pointer_tags.count(); ++i) {
+      const IfdEntry *entry = FindIfdEntry(node.entries, pointer_tags.at(i));
+      if (!entry)
+        continue;
+      if (node.depth >= limits().max_depth) {
+        set_truncated(true);
+        continue;
+      }
+      int unit_size;
+      if (entry->type == kLongType || entry->type == kIfdType)
+        unit_size = 4;
+      else if (entry->type == kLong8Type || entry->type == kIfd8Type)
+        unit_size = 8;
+      else
+        continue;
+      QByteArray value = IfdEntryValue(*entry);
+      for (int j = 0; j + unit_size <= value.size(); j += unit_size) {
+        if (nodes.count() + pending_nodes.count() >=
+            limits().max_ifd_count) {
+          set_truncated(true);
+          break;
+        }
+        quint64 offset = unit_size == 4 ?
+            DecodeUInt32<kBigEndians>(value.constData() + j) :
+            DecodeUInt64<kBigEndians>(value.constData() + j);
+        if (offset > static_cast<quint64>(file()->size()))
+          continue;
+        IfdNode child_node;
+        child_node.offset = static_cast<qint64>(offset) + file_start_offset();
+        child_node.parent = index;
+        child_node.parent_tag = entry->tag;
+        child_node.depth = node.depth + 1;
+        pending_nodes.append(child_node);
+      }
+    }
+  }
+  return nodes;
 }
 
 }  // namespace qmeta
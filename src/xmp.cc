@@ -26,52 +26,318 @@
 
 #include <QtCore>
 
+#include "qmeta/io.h"
+
 namespace qmeta {
 
-Xmp::Xmp(QObject *parent) : Standard(parent) {}
+namespace {
+
+// The wrapper header written by Serialize(), including the byte-order mark.
+const char kWrapperHeader[] =
+    "<?xpacket begin=\"\xef\xbb\xbf\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n";
+// The wrapper trailer written by Serialize(), allowing in-place updates.
+const char kWrapperTrailer[] = "<?xpacket end=\"w\"?>";
+// The namespace URI of RDF.
+const char kRdfNamespace[] = "http://www.w3.org/1999/02/22-rdf-syntax-ns#";
+// The namespace URI of the xml prefix.
+const char kXmlNamespace[] = "http://www.w3.org/XML/1998/namespace";
+// The padding size recommended by the XMP specification for new packets.
+const int kDefaultPaddingSize = 2048;
+// The length of padding lines. Padding is split into lines so text editors
+// can handle it.
+const int kPaddingLineLength = 100;
+
+}  // namespace
+
+Xmp::Xmp(QObject *parent)
+    : Standard(parent), is_parsed_(false), is_writable_(true),
+      packet_size_(0) {}
+
+// Returns the value of the specified field of the specified struct
+// property, or the first item if the field is an array. Returns a null
+// string if there is no such value.
+QString Xmp::FieldValue(const QString &namespace_uri, const QString &name,
+                        const QString &field_namespace_uri,
+                        const QString &field_name) {
+  const Property *property = FindProperty(
+      Key(namespace_uri, name) + "/" + Key(field_namespace_uri, field_name));
+  if (!property || property->values.isEmpty())
+    return QString();
+  return property->values.first();
+}
+
+// Returns the property with the specified key, or NULL if there is no such
+// property. The packet is parsed on the first call.
+const Xmp::Property* Xmp::FindProperty(const QString &key) {
+  if (!is_parsed_)
+    Parse();
+  QHash<QString, Property>::const_iterator iterator = properties_.find(key);
+  if (iterator == properties_.constEnd())
+    return NULL;
+  return &iterator.value();
+}
 
-// Initializes the Xmp object. Returns true if successful.
-bool Xmp::Init(QIODevice *file, qint64 file_start_offset) {
+// Initializes the Xmp object. packet_size is the number of bytes reserved
+// for the packet in the tracked file. If the packet has a wrapper, checks
+// that the wrapper header is closed and the wrapper trailer exists. Packets
+// without a wrapper are accepted as is. Returns true if successful.
+bool Xmp::Init(QIODevice *file, qint64 file_start_offset,
+               qint64 packet_size) {
   set_file(file);
   set_file_start_offset(file_start_offset);
+  set_packet_size(qMax(static_cast<qint64>(0), packet_size));
+  set_writable(true);
 
-  // Checks if wrapper exists. Return false if the header is invalid, or if
-  // the header is valid but the valid trailer is not found.
-  file->seek(file_start_offset);
-  if (QString(file->read(17)) == "<?xpacket begin=\"" &&
-      // Checks the Unicode "zero width non-breaking space charater" (U+FEFF)
-      // used as a byte-order marker.
-      file->read(3).toHex() == "efbbbf" &&
-      // Checks the rest part of the wrapper header.
-      file->read(31) == "\" id=\"W5M0MpCehiHzreSzNTczkc9d\"") {
-    // Makes sure the closing notation of the wrapper header exists.
-    // Note that header attributes other than "begin" and "id" are not
-    // supported currently.
-    bool header_is_valid = false;
-    while (!file->atEnd()) {
-      if (QString(file->read(1)) == "?" && QString(file->read(1)) == ">") {
-        header_is_valid = true;
-        break;
-      }
+  // Searches the wrapper within the packet in one read, which refers to
+  // the file content without copying if it is directly addressable. The
+  // header is searched forward and the trailer backward from the end of the
+  // packet, so only the header and the padding are scanned.
+  QByteArray packet = PacketView();
+  const QByteArray kHeaderStart("<?xpacket begin=");
+  if (!packet.startsWith(kHeaderStart))
+    return true;
+  // The header may contain attributes other than "begin" and "id".
+  int header_end = packet.indexOf("?>", kHeaderStart.size());
+  if (header_end == -1)
+    return false;
+  // The trailer is either <?xpacket end="w"?> or <?xpacket end="r"?>, in
+  // which case the packet must not be updated in place.
+  const QByteArray kTrailerStart("<?xpacket end=");
+  int trailer = packet.lastIndexOf(kTrailerStart);
+  if (trailer <= header_end)
+    return false;
+  QByteArray trailer_end = packet.mid(trailer + kTrailerStart.size(), 5);
+  if (trailer_end.size() != 5 || trailer_end.at(0) != trailer_end.at(2) ||
+      (trailer_end.at(0) != '"' && trailer_end.at(0) != '\'') ||
+      (trailer_end.at(1) != 'w' && trailer_end.at(1) != 'r') ||
+      !trailer_end.endsWith("?>"))
+    return false;
+  set_writable(trailer_end.at(1) == 'w');
+  return true;
+}
+
+// Returns the key of the property with the specified namespace URI and
+// local name. This is the expanded name of the property in RDF.
+QString Xmp::Key(const QString &namespace_uri, const QString &name) {
+  return namespace_uri + name;
+}
+
+// Returns the bytes reserved for the packet in the tracked file, including
+// the wrapper and the padding. The returned bytes are owned.
+QByteArray Xmp::Packet() {
+  return OwnedBytes(file(), PacketView());
+}
+
+// Returns the packet like Packet(), but the returned bytes refer to the file
+// content without copying if the file is directly addressable, and are only
+// valid as long as the file object exists and its content is unchanged.
+QByteArray Xmp::PacketView() {
+  return ReadBytesAt(file(), file_start_offset(), packet_size());
+}
+
+// Parses the properties of all rdf:Description elements in the packet with
+// a streaming reader, without building a document tree.
+void Xmp::Parse() {
+  is_parsed_ = true;
+  properties_.clear();
+  QXmlStreamReader reader(PacketView());
+  while (!reader.atEnd()) {
+    if (reader.readNext() == QXmlStreamReader::StartElement &&
+        reader.namespaceUri() == QLatin1String(kRdfNamespace) &&
+        reader.name() == QLatin1String("Description"))
+      ParseFields(&reader, QString());
+  }
+}
+
+// Parses the rdf:li items of the rdf:Bag, rdf:Seq, or rdf:Alt element at
+// the current position of the specified reader into an array property with
+// the specified key. Struct items are recorded as null strings. The reader
+// is left at the end of the array element.
+void Xmp::ParseArray(QXmlStreamReader *reader, const QString &key,
+                     PropertyType type) {
+  Property property;
+  property.type = type;
+  while (reader->readNextStartElement()) {
+    if (reader->namespaceUri() != QLatin1String(kRdfNamespace) ||
+        reader->name() != QLatin1String("li")) {
+      reader->skipCurrentElement();
+    } else if (reader->attributes().value(kRdfNamespace, "parseType") ==
+               QLatin1String("Resource")) {
+      property.values.append(QString());
+      reader->skipCurrentElement();
+    } else {
+      property.values.append(
+          reader->readElementText(QXmlStreamReader::SkipChildElements));
     }
-    // Returns false if the wrapper header is invalid.
-    if (!header_is_valid)
-      return false;
-    // Found wrapper header, now checks if the wrapper trailer exists.
-    bool found_trailer = false;
-    while (!file->atEnd()) {
-      if (QString(file->read(1)) == "<" && QString(file->read(1)) == "?" &&
-          QString(file->read(17)) == "xpacket end=\"w\"?>") {
-        found_trailer = true;
-        break;
+  }
+  properties_.insert(key, property);
+}
+
+// Parses the attributes and child elements of the element at the current
+// position of the specified reader as properties, prefixing their keys with
+// the specified prefix. Attributes in the RDF and xml namespaces are not
+// properties. The reader is left at the end of the element.
+void Xmp::ParseFields(QXmlStreamReader *reader, const QString &prefix) {
+  QXmlStreamAttributes attributes = reader->attributes();
+  for (int i = 0; i < attributes.count(); ++i) {
+    const QXmlStreamAttribute &attribute = attributes.at(i);
+    QString namespace_uri = attribute.namespaceUri().toString();
+    if (namespace_uri.isEmpty() || namespace_uri == kRdfNamespace ||
+        namespace_uri == kXmlNamespace)
+      continue;
+    Property property;
+    property.type = kSimpleProperty;
+    property.values.append(attribute.value().toString());
+    properties_.insert(prefix + Key(namespace_uri,
+                                    attribute.name().toString()),
+                       property);
+  }
+  while (reader->readNextStartElement()) {
+    ParseProperty(reader, prefix + Key(reader->namespaceUri().toString(),
+                                       reader->name().toString()));
+  }
+}
+
+// Parses the property element at the current position of the specified
+// reader into the property with the specified key. The reader is left at
+// the end of the property element.
+void Xmp::ParseProperty(QXmlStreamReader *reader, const QString &key) {
+  Property property;
+  QXmlStreamAttributes attributes = reader->attributes();
+  // A URI value.
+  if (attributes.hasAttribute(kRdfNamespace, "resource")) {
+    property.type = kSimpleProperty;
+    property.values.append(
+        attributes.value(kRdfNamespace, "resource").toString());
+    properties_.insert(key, property);
+    reader->skipCurrentElement();
+    return;
+  }
+  // A struct written with rdf:parseType="Resource" or with its fields as
+  // attributes.
+  bool has_field_attributes = false;
+  for (int i = 0; i < attributes.count(); ++i) {
+    QString namespace_uri = attributes.at(i).namespaceUri().toString();
+    if (!namespace_uri.isEmpty() && namespace_uri != kRdfNamespace &&
+        namespace_uri != kXmlNamespace)
+      has_field_attributes = true;
+  }
+  property.type = kStructProperty;
+  if (has_field_attributes ||
+      attributes.value(kRdfNamespace, "parseType") ==
+          QLatin1String("Resource")) {
+    properties_.insert(key, property);
+    ParseFields(reader, key + "/");
+    return;
+  }
+
+  QString text;
+  while (!reader->atEnd()) {
+    QXmlStreamReader::TokenType token = reader->readNext();
+    if (token == QXmlStreamReader::Characters) {
+      text.append(reader->text().toString());
+    } else if (token == QXmlStreamReader::EndElement) {
+      property.type = kSimpleProperty;
+      property.values.append(text);
+      properties_.insert(key, property);
+      return;
+    } else if (token == QXmlStreamReader::StartElement) {
+      if (reader->namespaceUri() != QLatin1String(kRdfNamespace)) {
+        reader->skipCurrentElement();
+        continue;
       }
+      // An array or a struct written as a nested rdf:Description.
+      if (reader->name() == QLatin1String("Bag")) {
+        ParseArray(reader, key, kBagProperty);
+      } else if (reader->name() == QLatin1String("Seq")) {
+        ParseArray(reader, key, kSeqProperty);
+      } else if (reader->name() == QLatin1String("Alt")) {
+        ParseArray(reader, key, kAltProperty);
+      } else if (reader->name() == QLatin1String("Description")) {
+        properties_.insert(key, property);
+        ParseFields(reader, key + "/");
+      } else {
+        reader->skipCurrentElement();
+        continue;
+      }
+      reader->skipCurrentElement();
+      return;
     }
-    if (!found_trailer)
-      return false;
-    // Found wrapper trailer. Now we can make sure the XMP wrapper is valid.
   }
+}
+
+// Returns a packet wrapping the specified serialized XMP metadata, which
+// should be the UTF-8 encoded x:xmpmeta or rdf:RDF element. The packet is
+// padded with whitespace to exactly packet_size bytes so it can be updated
+// in place later. If packet_size is 0, the recommended padding of 2 KB is
+// used. Returns an empty byte array if the metadata does not fit in
+// packet_size bytes.
+QByteArray Xmp::Serialize(const QByteArray &metadata, qint64 packet_size) {
+  QByteArray packet(kWrapperHeader);
+  packet.append(metadata);
+  packet.append('\n');
+  qint64 padding_size = kDefaultPaddingSize;
+  if (packet_size > 0) {
+    padding_size = packet_size - packet.size() -
+                   static_cast<int>(sizeof(kWrapperTrailer) - 1);
+    if (padding_size < 0)
+      return QByteArray();
+  }
+
+  int pos = packet.size();
+  packet.resize(pos + static_cast<int>(padding_size));
+  memset(packet.data() + pos, ' ', padding_size);
+  for (int i = kPaddingLineLength; i < padding_size;
+       i += kPaddingLineLength)
+    packet[pos + i - 1] = '\n';
+  packet.append(kWrapperTrailer);
+  return packet;
+}
+
+// Replaces the packet in the tracked file with a packet wrapping the
+// specified serialized XMP metadata. The new packet is written over the
+// reserved bytes and its padding absorbs the size difference, so nothing
+// else in the file moves. The tracked file must be writable and the packet
+// must not be marked read-only by its wrapper trailer. Returns false if the
+// metadata does not fit in the reserved bytes or the write failed.
+bool Xmp::Update(const QByteArray &metadata) {
+  if (packet_size() <= 0 || !is_writable())
+    return false;
+  QByteArray packet = Serialize(metadata, packet_size());
+  if (packet.isEmpty() ||
+      !WriteBytesAt(file(), file_start_offset(), packet))
+    return false;
+  // Parses the new packet on the next access.
+  is_parsed_ = false;
+  properties_.clear();
   return true;
 }
 
+// Returns the type of the specified property, or kInvalidProperty if the
+// property does not exist.
+Xmp::PropertyType Xmp::Type(const QString &namespace_uri,
+                            const QString &name) {
+  const Property *property = FindProperty(Key(namespace_uri, name));
+  return property ? property->type : kInvalidProperty;
+}
+
+// Returns the value of the specified simple property, or the first item of
+// the specified array property, which is the default language for language
+// alternatives. Returns a null string if there is no such value.
+QString Xmp::Value(const QString &namespace_uri, const QString &name) {
+  const Property *property = FindProperty(Key(namespace_uri, name));
+  if (!property || property->values.isEmpty())
+    return QString();
+  return property->values.first();
+}
+
+// Returns the items of the specified array property, such as the keywords
+// in dc:subject, or the value of the specified simple property as a single
+// item. Returns an empty list if there is no such property.
+QStringList Xmp::Values(const QString &namespace_uri, const QString &name) {
+  const Property *property = FindProperty(Key(namespace_uri, name));
+  return property ? property->values : QStringList();
+}
+
 }  // namespace qmeta
 